@@ -0,0 +1,105 @@
+#include "figurer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+/*
+ * Measures search throughput and heap usage for the storage precision this
+ * binary was built with. Build once with and once without
+ * FIGURER_SINGLE_PRECISION to compare.
+ *
+ * The problem is a point robot in a 24 dimensional space, large enough that
+ * state vectors and nearest neighbour scans dominate the cost of each node.
+ */
+
+namespace {
+    std::atomic<long> live_bytes{0};
+    std::atomic<long> peak_bytes{0};
+
+    const int dimension = 24;
+
+    double value_fn(std::vector<double> state) {
+        double result = 0;
+        for(double x : state) {
+            result -= fabs(x - 1.0);
+        }
+        return result;
+    }
+
+    figurer::Distribution policy_fn(std::vector<double> state) {
+        std::vector<double> bounds;
+        for(int i = 0; i < dimension; i++) {
+            bounds.push_back(-0.5);
+            bounds.push_back(0.5);
+        }
+        return figurer::uniform_distribution(bounds);
+    }
+
+    figurer::Distribution predict_fn(std::vector<double> state, std::vector<double> actuation) {
+        std::vector<double> bounds;
+        for(int i = 0; i < dimension; i++) {
+            double next = state[i] + actuation[i];
+            bounds.push_back(next - 0.01);
+            bounds.push_back(next + 0.01);
+        }
+        return figurer::uniform_distribution(bounds);
+    }
+}
+
+void* operator new(size_t size) {
+    // Prefix each allocation with its size so delete can account for it.
+    size_t* block = (size_t*) malloc(size + sizeof(size_t) * 2);
+    if(block == nullptr) {
+        throw std::bad_alloc();
+    }
+    block[0] = size;
+    long live = live_bytes += size;
+    long peak = peak_bytes;
+    while(live > peak && !peak_bytes.compare_exchange_weak(peak, live)) {}
+    return block + 2;
+}
+
+void operator delete(void* pointer) noexcept {
+    if(pointer == nullptr) {
+        return;
+    }
+    size_t* block = ((size_t*) pointer) - 2;
+    live_bytes -= block[0];
+    free(block);
+}
+
+void operator delete(void* pointer, size_t size) noexcept {
+    operator delete(pointer);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    figurer::Context context;
+    context.set_state_size(dimension);
+    context.set_actuation_size(dimension);
+    context.set_depth(10);
+    context.set_initial_state(std::vector<double>(dimension, 0.0));
+    context.set_value_fn(value_fn);
+    context.set_policy_fn(policy_fn);
+    context.set_predict_fn(predict_fn);
+
+    long bytes_before = live_bytes;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    context.figure_iterations(iterations);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end_time - start_time).count();
+    figurer::SearchStats stats = context.stats();
+    long tree_bytes = live_bytes - bytes_before;
+
+    std::cout << "coordinate bytes:     " << sizeof(figurer::real_t) << std::endl
+              << "iterations:           " << iterations << std::endl
+              << "iterations/second:    " << iterations / seconds << std::endl
+              << "state nodes:          " << stats.state_nodes << std::endl
+              << "distribution nodes:   " << stats.distribution_nodes << std::endl
+              << "tree heap bytes:      " << tree_bytes << std::endl
+              << "bytes per state node: " << tree_bytes / std::max(1, stats.state_nodes) << std::endl;
+    return 0;
+}
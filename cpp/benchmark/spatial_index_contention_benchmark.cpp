@@ -0,0 +1,87 @@
+#include "figurer_concurrent_spatial_index.hpp"
+#include "figurer_spatial_index.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+/*
+ * Throughput of concurrent_spatial_index under contention, compared with a
+ * spatial_index guarded by a single mutex. Each thread interleaves inserts
+ * and nearest neighbour lookups in the ratio seen during tree expansion,
+ * where most expansions search the index and many then insert. Every thread
+ * adds to the same index, so it holds more points as the thread count grows.
+ * With few points the locked linear scan wins, since searching rings of grid
+ * cells costs more than scanning everything.
+ */
+
+namespace {
+    const int dimension = 4;
+    const int lookups_per_insert = 3;
+    // Grid cells over coordinates in [-10,10].
+    const double cell_size = 2.0;
+
+    std::vector<double> random_point(std::mt19937& generator) {
+        std::uniform_real_distribution<double> coordinate(-10.0, 10.0);
+        std::vector<double> point;
+        for(int i = 0; i < dimension; i++) {
+            point.push_back(coordinate(generator));
+        }
+        return point;
+    }
+
+    template<typename Work>
+    double operations_per_second(int thread_count, int operations_per_thread, Work work) {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for(int t = 0; t < thread_count; t++) {
+            threads.emplace_back([t, operations_per_thread, &work]() {
+                std::mt19937 generator(t);
+                for(int i = 0; i < operations_per_thread; i++) {
+                    work(t * operations_per_thread + i, i % (lookups_per_insert + 1) == 0, random_point(generator));
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end_time - start_time).count();
+        return thread_count * operations_per_thread / seconds;
+    }
+}
+
+int main(int argc, char** argv) {
+    int operations_per_thread = argc > 1 ? atoi(argv[1]) : 4000;
+    std::cout << "threads  concurrent ops/s  mutex ops/s" << std::endl;
+    for(int thread_count = 1; thread_count <= 32; thread_count *= 2) {
+        figurer::concurrent_spatial_index concurrent(dimension, cell_size);
+        concurrent.add(-1, std::vector<double>(dimension, 0.0));
+        double concurrent_rate = operations_per_second(thread_count, operations_per_thread,
+                [&concurrent](int id, bool insert, const std::vector<double>& point) {
+                    if(insert) {
+                        concurrent.add(id, point);
+                    } else {
+                        concurrent.closest(point);
+                    }
+                });
+
+        figurer::spatial_index locked(dimension);
+        std::mutex mutex;
+        locked.add(-1, std::vector<double>(dimension, 0.0));
+        double locked_rate = operations_per_second(thread_count, operations_per_thread,
+                [&locked, &mutex](int id, bool insert, const std::vector<double>& point) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(insert) {
+                        locked.add(id, point);
+                    } else {
+                        locked.closest(point);
+                    }
+                });
+
+        std::cout << thread_count << "\t " << concurrent_rate << "\t   " << locked_rate << std::endl;
+    }
+    return 0;
+}
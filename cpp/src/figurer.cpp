@@ -1,4 +1,5 @@
 #include "figurer.hpp"
+#include "figurer_trace.hpp"
 #include <algorithm>
 #include <chrono>
 #include <cmath>
@@ -9,14 +10,23 @@
 
 namespace figurer {
 
-    Context::Context() : value_fn_{nullptr}, policy_fn_{nullptr}, predict_fn_{nullptr},
-        state_size_{-1}, actuation_size_{-1}, initial_state_node_id_{-1},
-        max_state_node_id_{0}, max_distribution_node_id_{0}, depth_{-1},
-        rootSpread_{-1}, avg_dist_sparsity_{-1},
-        state_to_node_id_{},
+    Context::Context() : state_size_{-1}, actuation_size_{-1}, depth_{-1},
+        rollout_depth_{-1}, rollout_fn_{nullptr},
+        rootSpread_{-1},
         maxValueSoFar_{std::numeric_limits<double>::min() / 2.0},
-        minValueSoFar_{std::numeric_limits<double>::max() / 2.0} {}
+        minValueSoFar_{std::numeric_limits<double>::max() / 2.0},
+        avg_dist_sparsity_{-1},
+        state_to_node_id_{}, value_fn_{nullptr}, policy_fn_{nullptr}, predict_fn_{nullptr},
+        prior_weight_{0}, prior_spread_{0}, quasi_random_{false}, random_{},
+        pruning_margin_{-1}, free_pruned_{false}, pruned_branches_{0},
+        aim_candidates_{1}, aim_distance_ratio_{0.04}, aim_score_ratio_{0.2}, aimed_expansions_{0},
+        best_action_fn_{nullptr}, has_best_root_actuation_{false},
+        compaction_interval_{0}, iterations_since_compaction_{0} {}
 
+    Context::Context(const Context& other) = default;
+    Context::Context(Context&& other) = default;
+    Context& Context::operator=(const Context& other) = default;
+    Context& Context::operator=(Context&& other) = default;
     Context::~Context() = default;
 
     void Context::set_state_size(int state_size) { state_size_ = state_size; }
@@ -29,21 +39,145 @@ namespace figurer {
         initial_state_ = move(initial_state);
     }
 
-    void Context::set_value_fn(std::function<double(std::vector<double>)> value_fn) {
-        value_fn_ = move(value_fn);
+    void Context::set_rollout_depth(int rollout_depth) { rollout_depth_ = rollout_depth; }
+
+    void Context::set_callback_cache(int capacity, double grid_size) {
+        if(capacity > 0 && grid_size <= 0) {
+            throw std::invalid_argument("Cache grid size must be positive");
+        }
+        policy_cache_.configure(capacity, grid_size);
+        predict_cache_.configure(capacity, grid_size);
+    }
+
+    double Context::value(vector_view state) {
+        FIGURER_TRACE_SCOPE("value_fn");
+        return value_fn_(state);
     }
 
-    void Context::set_policy_fn(std::function<Distribution(std::vector<double>)> policy_fn) {
-        policy_fn_ = move(policy_fn);
+    Distribution Context::policy(vector_view state) {
+        auto call = [this, state]() {
+            FIGURER_TRACE_SCOPE("policy_fn");
+            return policy_fn_(state);
+        };
+        if(!policy_cache_.enabled()) {
+            return call();
+        }
+        return policy_cache_.lookup(quantize(state, policy_cache_.grid_size()), call);
+    }
+
+    Distribution Context::predict(vector_view state, vector_view actuation) {
+        auto call = [this, state, actuation]() {
+            FIGURER_TRACE_SCOPE("predict_fn");
+            return predict_fn_(state, actuation);
+        };
+        if(!predict_cache_.enabled()) {
+            return call();
+        }
+        return predict_cache_.lookup(quantize(state, actuation, predict_cache_.grid_size()), call);
     }
 
-    void Context::set_predict_fn(std::function<Distribution(std::vector<double>,std::vector<double>)> predict_fn) {
-        predict_fn_ = move(predict_fn);
+    void Context::predict_inverse(vector_view state1, vector_view state2, std::vector<double>& actuation) {
+        FIGURER_TRACE_SCOPE("predict_inverse_fn");
+        predict_inverse_fn_(state1, state2, actuation);
     }
 
-    void Context::set_predict_inverse_fn(std::function<std::vector<double>(std::vector<double>,std::vector<double>)>
-            predict_inverse_fn) {
-        predict_inverse_fn_ = move(predict_inverse_fn);
+    void Context::predict_inverse(vector_view state1, const std::vector<vector_view>& targets,
+                                  std::vector<std::vector<double>>& actuations) {
+        actuations.resize(targets.size());
+        if(targets.empty()) {
+            return;
+        }
+        if(!predict_inverse_batch_fn_) {
+            for(size_t i = 0; i < targets.size(); i++) {
+                predict_inverse(state1, targets[i], actuations[i]);
+            }
+            return;
+        }
+        FIGURER_TRACE_SCOPE("predict_inverse_batch_fn");
+        predict_inverse_batch_fn_(state1, targets, actuations);
+        if(actuations.size() != targets.size()) {
+            throw std::invalid_argument("predict_inverse_batch_fn yields " + std::to_string(actuations.size()) +
+                                        " actuations for " + std::to_string(targets.size()) + " targets");
+        }
+        for(auto& actuation : actuations) {
+            if(actuation_size_ > 0 && actuation.size() != (size_t) actuation_size_) {
+                throw std::invalid_argument("predict_inverse_batch_fn yields actuation of size " +
+                                            std::to_string(actuation.size()) + " but actuation size is " +
+                                            std::to_string(actuation_size_));
+            }
+        }
+    }
+
+    void Context::predict(vector_view state, const std::vector<vector_view>& actuations,
+                          std::vector<Distribution>& distributions) {
+        distributions.assign(actuations.size(), Distribution());
+        if(!predict_batch_fn_) {
+            for(size_t i = 0; i < actuations.size(); i++) {
+                distributions[i] = predict(state, actuations[i]);
+            }
+            return;
+        }
+        // Only cache misses go to predict_batch_fn.
+        std::vector<quantized_key> keys(actuations.size());
+        std::vector<size_t> missing;
+        std::vector<vector_view> missing_actuations;
+        for(size_t i = 0; i < actuations.size(); i++) {
+            if(predict_cache_.enabled()) {
+                keys[i] = quantize(state, actuations[i], predict_cache_.grid_size());
+                if(predict_cache_.find(keys[i], distributions[i])) {
+                    continue;
+                }
+            }
+            missing.push_back(i);
+            missing_actuations.push_back(actuations[i]);
+        }
+        if(missing.empty()) {
+            return;
+        }
+        std::vector<Distribution> computed;
+        {
+            FIGURER_TRACE_SCOPE("predict_batch_fn");
+            predict_batch_fn_(state, missing_actuations, computed);
+        }
+        if(computed.size() != missing.size()) {
+            throw std::invalid_argument("predict_batch_fn yields " + std::to_string(computed.size()) +
+                                        " distributions for " + std::to_string(missing.size()) + " actuations");
+        }
+        for(size_t m = 0; m < missing.size(); m++) {
+            if(predict_cache_.enabled()) {
+                predict_cache_.insert(keys[missing[m]], computed[m]);
+            }
+            distributions[missing[m]] = std::move(computed[m]);
+        }
+    }
+
+    void Context::set_predict_inverse_batch_fn(
+            std::function<void(vector_view,const std::vector<vector_view>&,std::vector<std::vector<double>>&)>
+            predict_inverse_batch_fn) {
+        predict_inverse_batch_fn_ = move(predict_inverse_batch_fn);
+    }
+
+    void Context::set_predict_batch_fn(
+            std::function<void(vector_view,const std::vector<vector_view>&,std::vector<Distribution>&)>
+            predict_batch_fn) {
+        predict_batch_fn_ = move(predict_batch_fn);
+    }
+
+    SearchStats Context::stats() const {
+        SearchStats result{};
+        result.policy_cache_hits = policy_cache_.hits();
+        result.policy_cache_misses = policy_cache_.misses();
+        result.predict_cache_hits = predict_cache_.hits();
+        result.predict_cache_misses = predict_cache_.misses();
+        result.state_nodes = state_nodes_.size();
+        result.expanded_state_nodes = state_expansions_.size();
+        result.distribution_nodes = distribution_nodes_.size();
+        result.neighbor_recall_samples = state_to_node_id_.recall_samples();
+        result.neighbor_recall_hits = state_to_node_id_.recall_hits();
+        result.pruned_branches = pruned_branches_;
+        result.aimed_expansions = aimed_expansions_;
+        result.tree_memory_bytes = tree_memory_.bytes();
+        return result;
     }
 
     void Context::figure_seconds(double seconds) {
@@ -66,6 +200,103 @@ namespace figurer {
         }
     }
 
+    FigureResult Context::figure_until(const StopCriteria& criteria) {
+        if(criteria.max_seconds < 0 && criteria.max_iterations < 0) {
+            throw std::invalid_argument("figure_until needs max_seconds or max_iterations");
+        }
+        auto duration = std::chrono::microseconds((long) (criteria.max_seconds * pow(10,6)));
+        auto start_time = std::chrono::high_resolution_clock::now();
+        this->ensure_consistent_state();
+        FigureResult result{};
+        while(true) {
+            if(criteria.max_iterations >= 0 && result.iterations >= criteria.max_iterations) {
+                result.reason = StopReason::IterationLimit;
+                break;
+            }
+            figure_once();
+            result.iterations++;
+            if(criteria.stop_on_action_separation && root_action_separated(criteria.separation_margin)) {
+                result.reason = StopReason::ActionSeparated;
+                break;
+            }
+            if(criteria.root_error_threshold >= 0
+                    && state_stats_.total_error[initial_state_node_id_] < criteria.root_error_threshold) {
+                result.reason = StopReason::ErrorThreshold;
+                break;
+            }
+            if(criteria.max_seconds >= 0 && std::chrono::high_resolution_clock::now() - start_time > duration) {
+                result.reason = StopReason::TimeLimit;
+                break;
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+        return result;
+    }
+
+    bool Context::root_action_separated(double margin) const {
+        const auto& root_edges = children(initial_state_node_id_);
+        if(root_edges.size() < 2) {
+            return false;
+        }
+        int best_id = -1;
+        for(auto& edge : root_edges) {
+            int next_id = edge.distribution_node_id;
+            if(best_id < 0 || distribution_stats_.value[next_id] > distribution_stats_.value[best_id]) {
+                best_id = next_id;
+            }
+        }
+        double best_lower_bound = distribution_stats_.value[best_id] - distribution_stats_.total_error[best_id];
+        for(auto& edge : root_edges) {
+            int next_id = edge.distribution_node_id;
+            if(next_id != best_id
+                    && distribution_stats_.value[next_id] + distribution_stats_.total_error[next_id] > best_lower_bound + margin) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<RootAction> Context::root_actions() const {
+        std::vector<RootAction> result;
+        if(initial_state_node_id_ < 0) {
+            return result;
+        }
+        for(auto& edge : children(initial_state_node_id_)) {
+            int id = edge.distribution_node_id;
+            result.push_back(RootAction{to_double(edge.actuation), distribution_stats_.value[id],
+                                        distribution_stats_.total_error[id], distribution_stats_.visits[id]});
+        }
+        return result;
+    }
+
+    Plan Context::principal_variation() const {
+        Plan plan;
+        if(initial_state_node_id_ < 0) {
+            return plan;
+        }
+        int state_node_id = initial_state_node_id_;
+        plan.states.push_back(to_double(state_nodes_[state_node_id].state));
+        for(int i = 0; i < depth_; i++) {
+            int expansion_id = state_nodes_[state_node_id].expansion_id;
+            if(expansion_id < 0 || state_expansions_[expansion_id].best_edge_index < 0) {
+                break;
+            }
+            const StateNodeExpansion& expansion = state_expansions_[expansion_id];
+            const StateDistributionEdge& edge = expansion.next_distribution_nodes[expansion.best_edge_index];
+            const DistributionNode& dist_node = distribution_nodes_[edge.distribution_node_id];
+            if(dist_node.next_state_nodes.empty()) {
+                break;
+            }
+            // Follow the most likely outcome.
+            auto outcome = std::max_element(dist_node.next_state_nodes.begin(), dist_node.next_state_nodes.end(),
+                    [](const DistributionStateEdge& a, const DistributionStateEdge& b) { return a.density < b.density; });
+            state_node_id = outcome->state_node_id;
+            plan.actuations.push_back(to_double(edge.actuation));
+            plan.states.push_back(to_double(state_nodes_[state_node_id].state));
+        }
+        return plan;
+    }
+
     Plan Context::sample_plan() {
         return sample_plan(depth_);
     }
@@ -78,23 +309,16 @@ namespace figurer {
         plan.states.push_back(initial_state_);
         for(int i = 0; i < depth; i++) {
             std::cout << i << ": state node id " << state_node_id << std::endl;
-            // Select actuation and next distribution node that maximize expected value.
-            auto state_node = node_id_to_state_node_.at(state_node_id);
-            double max_value = 0.0;
-            int next_dist_id = -1;
-            for(const auto& edge : state_node.next_distribution_nodes) {
-                auto& next_node = node_id_to_distribution_node_.at(edge.second.distribution_node_id);
-                if(next_dist_id < 0 || next_node.value > max_value) {
-                    std::cout << "  dist node " << next_node.node_id << " has higher value of " << next_node.value << std::endl;
-                    max_value = next_node.value;
-                    next_dist_id = next_node.node_id;
-                }
-            }
-            if(next_dist_id < 0) {
+            // Follow the child that maximized expected value when this node was last refreshed.
+            int expansion_id = state_nodes_.at(state_node_id).expansion_id;
+            if(expansion_id < 0 || state_expansions_[expansion_id].best_edge_index < 0) {
                 return plan;
             }
-            std::vector<double> actuation = state_node.next_distribution_nodes.at(next_dist_id).actuation;
-            auto& dist_node = node_id_to_distribution_node_.at(next_dist_id);
+            const StateNodeExpansion& expansion = state_expansions_[expansion_id];
+            const StateDistributionEdge& next_edge = expansion.next_distribution_nodes[expansion.best_edge_index];
+            int next_dist_id = next_edge.distribution_node_id;
+            std::vector<double> actuation = to_double(next_edge.actuation);
+            const DistributionNode& dist_node = distribution_nodes_.at(next_dist_id);
             std::cout << "final dist node " << next_dist_id << " has actuation ";
             for(int j = 0; j < actuation.size(); j++) {
                 if(j > 0) {
@@ -108,28 +332,528 @@ namespace figurer {
             if(dist_node.next_state_nodes.empty()) {
                 return plan;
             }
-            std::vector<std::pair<int,DistributionStateEdge>> sample_out;
+            std::vector<DistributionStateEdge> sample_out;
             std::sample(dist_node.next_state_nodes.begin(),dist_node.next_state_nodes.end(),
-                    std::back_inserter(sample_out), 1, std::mt19937{std::random_device{}()});
-            state_node_id = sample_out[0].second.state_node_id;
-            state_node = node_id_to_state_node_.at(state_node_id);
+                    std::back_inserter(sample_out), 1, random_);
+            state_node_id = sample_out[0].state_node_id;
+            const StateNode& next_state_node = state_nodes_.at(state_node_id);
 
             std::cout << "sampled next state node " << state_node_id << " with state ";
-            for(int j = 0; j < state_node.state.size(); j++) {
+            for(int j = 0; j < next_state_node.state.size(); j++) {
                 if(j > 0) {
                     std::cout << ", ";
                 }
-                std::cout << state_node.state[j];
+                std::cout << next_state_node.state[j];
             }
             std::cout << std::endl << std::endl;
 
             // Add step to plan based on selected distribution and state nodes.
             plan.actuations.push_back(actuation);
-            plan.states.push_back(state_node.state);
+            plan.states.push_back(to_double(next_state_node.state));
         }
         return plan;
     }
 
+    StateNode::StateNode(std::pmr::memory_resource* memory) : level{0}, expansion_id{-1},
+        direct_value{0}, rollout_value{0}, rollout_steps{0}, state{memory} {}
+
+    DistributionNode::DistributionNode(std::pmr::memory_resource* memory) : node_id{0}, level{0},
+        next_state_distribution{}, state_seeds{}, next_state_nodes{memory} {}
+
+    namespace {
+        // Copy edges into memory. Actuations are rebuilt rather than copied along with the
+        // vector so that they are also allocated from memory.
+        void copy_edges(const std::pmr::vector<StateDistributionEdge>& from,
+                        std::pmr::vector<StateDistributionEdge>& to, std::pmr::memory_resource* memory) {
+            to.reserve(from.size());
+            for(auto& edge : from) {
+                to.push_back(StateDistributionEdge{edge.state_node_id, edge.distribution_node_id,
+                                                   node_vector(edge.actuation.begin(), edge.actuation.end(), memory)});
+            }
+        }
+    }
+
+    StateNode::StateNode(const StateNode& other, std::pmr::memory_resource* memory) : level{other.level},
+        expansion_id{other.expansion_id}, direct_value{other.direct_value}, rollout_value{other.rollout_value},
+        rollout_steps{other.rollout_steps}, state{other.state.begin(), other.state.end(), memory} {}
+
+    StateNodeExpansion::StateNodeExpansion(StateNodeExpansion&& other, std::pmr::memory_resource* memory) :
+        next_actuation_distribution{std::move(other.next_actuation_distribution)},
+        actuations_so_far{std::move(other.actuations_so_far)}, actuation_seeds{std::move(other.actuation_seeds)},
+        action_children{std::move(other.action_children)}, tried_actions{std::move(other.tried_actions)},
+        action_actuations{std::move(other.action_actuations)}, best_edge_index{other.best_edge_index},
+        next_distribution_nodes{memory}, pruned_distribution_nodes{memory}, pruned_count{other.pruned_count} {
+        copy_edges(other.next_distribution_nodes, next_distribution_nodes, memory);
+        copy_edges(other.pruned_distribution_nodes, pruned_distribution_nodes, memory);
+    }
+
+    StateNodeExpansion::StateNodeExpansion(const StateNodeExpansion& other, std::pmr::memory_resource* memory) :
+        next_actuation_distribution{other.next_actuation_distribution},
+        actuations_so_far{other.actuations_so_far}, actuation_seeds{other.actuation_seeds},
+        action_children{other.action_children}, tried_actions{other.tried_actions},
+        action_actuations{other.action_actuations}, best_edge_index{other.best_edge_index},
+        next_distribution_nodes{memory}, pruned_distribution_nodes{memory}, pruned_count{other.pruned_count} {
+        copy_edges(other.next_distribution_nodes, next_distribution_nodes, memory);
+        copy_edges(other.pruned_distribution_nodes, pruned_distribution_nodes, memory);
+    }
+
+    DistributionNode::DistributionNode(DistributionNode&& other, std::pmr::memory_resource* memory) :
+        node_id{other.node_id}, level{other.level}, next_state_distribution{std::move(other.next_state_distribution)},
+        state_seeds{std::move(other.state_seeds)},
+        next_state_nodes{other.next_state_nodes.begin(), other.next_state_nodes.end(), memory} {}
+
+    DistributionNode::DistributionNode(const DistributionNode& other, std::pmr::memory_resource* memory) :
+        node_id{other.node_id}, level{other.level}, next_state_distribution{other.next_state_distribution},
+        state_seeds{other.state_seeds},
+        next_state_nodes{other.next_state_nodes.begin(), other.next_state_nodes.end(), memory} {}
+
+    // Passes allocations through to the heap, keeping count of bytes outstanding.
+    class TreeMemory::counting_resource : public std::pmr::memory_resource {
+    public:
+        size_t bytes = 0;
+    private:
+        void* do_allocate(size_t size, size_t alignment) override {
+            void* result = std::pmr::new_delete_resource()->allocate(size, alignment);
+            bytes += size;
+            return result;
+        }
+        void do_deallocate(void* p, size_t size, size_t alignment) override {
+            bytes -= size;
+            std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    TreeMemory::TreeMemory() : upstream_{new counting_resource()},
+        resource_{new std::pmr::monotonic_buffer_resource(upstream_.get())} {}
+
+    TreeMemory::~TreeMemory() = default;
+
+    // Copied nodes are allocated from the copy's own arena, so there is nothing to share.
+    TreeMemory::TreeMemory(const TreeMemory&) : TreeMemory() {}
+
+    TreeMemory::TreeMemory(TreeMemory&& other) : TreeMemory() {
+        swap(other);
+    }
+
+    TreeMemory& TreeMemory::operator=(const TreeMemory&) {
+        // Keep this arena, which still holds this context's nodes.
+        return *this;
+    }
+
+    std::pmr::memory_resource* TreeMemory::resource() const {
+        return resource_.get();
+    }
+
+    size_t TreeMemory::bytes() const {
+        return upstream_->bytes;
+    }
+
+    void TreeMemory::release() {
+        resource_->release();
+    }
+
+    void TreeMemory::swap(TreeMemory& other) {
+        upstream_.swap(other.upstream_);
+        resource_.swap(other.resource_);
+    }
+
+    TreeStorage::TreeStorage() : initial_state_node_id_{-1} {}
+
+    TreeStorage::TreeStorage(const TreeStorage& other) : initial_state_node_id_{other.initial_state_node_id_} {
+        state_nodes_.reserve(other.state_nodes_.size());
+        for(auto& node : other.state_nodes_) {
+            state_nodes_.emplace_back(node, tree_memory_.resource());
+        }
+        distribution_nodes_.reserve(other.distribution_nodes_.size());
+        for(auto& node : other.distribution_nodes_) {
+            distribution_nodes_.emplace_back(node, tree_memory_.resource());
+        }
+        state_expansions_.reserve(other.state_expansions_.size());
+        for(auto& expansion : other.state_expansions_) {
+            state_expansions_.emplace_back(expansion, tree_memory_.resource());
+        }
+    }
+
+    TreeStorage::TreeStorage(TreeStorage&& other) : tree_memory_{std::move(other.tree_memory_)},
+        state_nodes_{std::move(other.state_nodes_)}, distribution_nodes_{std::move(other.distribution_nodes_)},
+        state_expansions_{std::move(other.state_expansions_)}, initial_state_node_id_{other.initial_state_node_id_} {
+        other.state_nodes_.clear();
+        other.distribution_nodes_.clear();
+        other.state_expansions_.clear();
+        other.initial_state_node_id_ = -1;
+    }
+
+    TreeStorage& TreeStorage::operator=(const TreeStorage& other) {
+        if(this != &other) {
+            TreeStorage copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    TreeStorage& TreeStorage::operator=(TreeStorage&& other) {
+        // Nodes must go before the arena they came from, so the old tree leaves with moved.
+        TreeStorage moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    void TreeStorage::swap(TreeStorage& other) {
+        tree_memory_.swap(other.tree_memory_);
+        state_nodes_.swap(other.state_nodes_);
+        distribution_nodes_.swap(other.distribution_nodes_);
+        state_expansions_.swap(other.state_expansions_);
+        std::swap(initial_state_node_id_, other.initial_state_node_id_);
+    }
+
+    StateNodeExpansion::StateNodeExpansion(Distribution distribution, halton_sequence seeds,
+                                           std::pmr::memory_resource* memory) :
+            next_actuation_distribution{std::move(distribution)}, actuations_so_far{}, actuation_seeds{std::move(seeds)},
+            best_edge_index{-1}, next_distribution_nodes{memory}, pruned_distribution_nodes{memory}, pruned_count{0} {
+        int action_count = next_actuation_distribution.action_count();
+        if(next_actuation_distribution.hybrid()) {
+            action_actuations.resize(action_count);
+        } else {
+            action_children.assign(action_count, -1);
+            tried_actions.assign(action_count, false);
+        }
+    }
+
+    bool StateNodeExpansion::discrete() const {
+        return !action_children.empty();
+    }
+
+    int StateNodeExpansion::untried_action() const {
+        int best_action = -1;
+        double best_probability = 0;
+        for(size_t action = 0; action < action_children.size(); action++) {
+            double probability = next_actuation_distribution.action_probability(action);
+            if(!tried_actions[action] && probability > best_probability) {
+                best_action = action;
+                best_probability = probability;
+            }
+        }
+        return best_action;
+    }
+
+    void StateNodeExpansion::add_actuation(int distribution_node_id, const std::vector<double>& actuation) {
+        if(discrete()) {
+            int action = (int) actuation[0];
+            if(action >= 0 && (size_t) action < action_children.size() && action_children[action] < 0) {
+                action_children[action] = distribution_node_id;
+                tried_actions[action] = true;
+            }
+        } else if(!action_actuations.empty()) {
+            int action = (int) actuation[0];
+            if(action >= 0 && (size_t) action < action_actuations.size()) {
+                action_actuations[action].add(distribution_node_id,
+                                              std::vector<double>(actuation.begin() + 1, actuation.end()));
+            }
+        } else {
+            actuations_so_far.add(distribution_node_id, actuation);
+        }
+    }
+
+    void StateNodeExpansion::clear_actuations() {
+        actuations_so_far = spatial_index();
+        std::fill(action_children.begin(), action_children.end(), -1);
+        for(auto& index : action_actuations) {
+            index = spatial_index();
+        }
+    }
+
+    double StateNodeExpansion::closest_actuation_distance(const std::vector<double>& actuation) {
+        if(action_actuations.empty()) {
+            return actuations_so_far.size() > 0 ? actuations_so_far.closest_distance(actuation) : 1.0;
+        }
+        int action = (int) actuation[0];
+        if(action < 0 || (size_t) action >= action_actuations.size() || action_actuations[action].size() == 0) {
+            return 1.0;
+        }
+        return action_actuations[action].closest_distance(std::vector<double>(actuation.begin() + 1, actuation.end()));
+    }
+
+    void NodeStatistics::clear() {
+        value.clear();
+        child_error.clear();
+        sparsity_error.clear();
+        total_error.clear();
+        depth.clear();
+        visits.clear();
+    }
+
+    void NodeStatistics::add() {
+        value.push_back(0);
+        child_error.push_back(0);
+        sparsity_error.push_back(0);
+        total_error.push_back(0);
+        depth.push_back(0);
+        visits.push_back(0);
+    }
+
+    template<typename T>
+    static void reorder_vector(std::vector<T>& values, const std::vector<int>& order) {
+        std::vector<T> result;
+        result.reserve(order.size());
+        for(int old_index : order) {
+            result.push_back(values[old_index]);
+        }
+        values.swap(result);
+    }
+
+    void NodeStatistics::reorder(const std::vector<int>& order) {
+        reorder_vector(value, order);
+        reorder_vector(child_error, order);
+        reorder_vector(sparsity_error, order);
+        reorder_vector(total_error, order);
+        reorder_vector(depth, order);
+        reorder_vector(visits, order);
+    }
+
+    void Context::set_approximate_state_index(int projected_dimension, int candidates) {
+        state_to_node_id_.set_approximate(projected_dimension, candidates);
+    }
+
+    void Context::set_prior_plan(const Plan& plan, double weight, double spread) {
+        if(weight < 0 || weight > 1) {
+            throw std::invalid_argument("Prior plan weight must be between 0 and 1");
+        }
+        if(weight > 0 && spread <= 0) {
+            throw std::invalid_argument("Prior plan spread must be positive");
+        }
+        prior_actuations_.clear();
+        if(plan.actuations.size() > 1) {
+            prior_actuations_.assign(plan.actuations.begin() + 1, plan.actuations.end());
+        }
+        prior_weight_ = weight;
+        prior_spread_ = spread;
+    }
+
+    Distribution Context::proposal(const Distribution& policy, int level) {
+        // Mixing in a continuous box would hide the action probabilities of discrete policies.
+        if(prior_weight_ <= 0 || (size_t) level >= prior_actuations_.size() || policy.action_count() > 0) {
+            return policy;
+        }
+        std::vector<double> bounds;
+        for(double x : prior_actuations_[level]) {
+            bounds.push_back(x - prior_spread_);
+            bounds.push_back(x + prior_spread_);
+        }
+        return mixture_distribution({policy, uniform_distribution(bounds)}, {1 - prior_weight_, prior_weight_});
+    }
+
+    void Context::set_quasi_random_sampling(bool enabled) {
+        quasi_random_ = enabled;
+    }
+
+    void Context::set_seed(uint32_t seed) {
+        random_.seed(seed);
+    }
+
+    std::vector<double> Context::random_sample(Distribution& distribution) {
+        int size = distribution.seed_dimension();
+        if(size < 0) {
+            throw std::invalid_argument("Need to set seed_dimension before sampling");
+        }
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::vector<double> seed(size);
+        for(auto& x : seed) {
+            x = uniform(random_);
+        }
+        return distribution.sample(seed);
+    }
+
+    halton_sequence Context::new_seed_sequence() {
+        if(!quasi_random_) {
+            return halton_sequence();
+        }
+        return halton_sequence(random_());
+    }
+
+    std::vector<double> Context::sample_node(Distribution& distribution, halton_sequence& seeds) {
+        if(!quasi_random_) {
+            return random_sample(distribution);
+        }
+        return distribution.sample(seeds.next(distribution.seed_dimension()));
+    }
+
+    void Context::reset(std::vector<double> initial_state) {
+        state_nodes_.clear();
+        distribution_nodes_.clear();
+        state_expansions_.clear();
+        state_stats_.clear();
+        distribution_stats_.clear();
+        state_to_node_id_.clear();
+        tree_memory_.release();
+        initial_state_node_id_ = -1;
+        has_best_root_actuation_ = false;
+        iterations_since_compaction_ = 0;
+        rootSpread_ = -1;
+        avg_dist_sparsity_ = -1;
+        maxValueSoFar_ = std::numeric_limits<double>::min() / 2.0;
+        minValueSoFar_ = std::numeric_limits<double>::max() / 2.0;
+        initial_state_ = move(initial_state);
+    }
+
+    void Context::set_pruning(double margin, bool free_pruned) {
+        pruning_margin_ = margin;
+        free_pruned_ = free_pruned;
+    }
+
+    bool Context::prune_dominated_children(StateNodeExpansion& expansion, double threshold) {
+        auto& edges = expansion.next_distribution_nodes;
+        size_t active_count = edges.size();
+        auto kept = edges.begin();
+        for(auto edge = edges.begin(); edge != edges.end(); ++edge) {
+            int next_id = edge->distribution_node_id;
+            if(distribution_stats_.value[next_id] + distribution_stats_.total_error[next_id] < threshold) {
+                pruned_branches_++;
+                expansion.pruned_count++;
+                if(!free_pruned_) {
+                    expansion.pruned_distribution_nodes.push_back(std::move(*edge));
+                }
+            } else {
+                if(kept != edge) {
+                    *kept = std::move(*edge);
+                }
+                ++kept;
+            }
+        }
+        edges.erase(kept, edges.end());
+        return edges.size() != active_count;
+    }
+
+    void Context::set_best_action_fn(std::function<void(const std::vector<double>&)> best_action_fn) {
+        best_action_fn_ = move(best_action_fn);
+    }
+
+    void Context::notify_if_best_action_changed() {
+        const StateNodeExpansion& root = state_expansions_[state_nodes_[initial_state_node_id_].expansion_id];
+        if(root.best_edge_index < 0) {
+            return;
+        }
+        const node_vector& best_actuation = root.next_distribution_nodes[root.best_edge_index].actuation;
+        if(has_best_root_actuation_ && same_coordinates(best_actuation, best_root_actuation_)) {
+            return;
+        }
+        has_best_root_actuation_ = true;
+        best_root_actuation_ = to_double(best_actuation);
+        best_action_fn_(best_root_actuation_);
+    }
+
+    void Context::set_aiming(int candidates, double distance_ratio, double score_ratio) {
+        if(candidates < 1) {
+            throw std::invalid_argument("Aiming needs at least one candidate");
+        }
+        aim_candidates_ = candidates;
+        aim_distance_ratio_ = distance_ratio;
+        aim_score_ratio_ = score_ratio;
+    }
+
+    void Context::set_compaction_interval(int iterations) {
+        compaction_interval_ = iterations;
+        iterations_since_compaction_ = 0;
+    }
+
+    void Context::compact() {
+        iterations_since_compaction_ = 0;
+        if(initial_state_node_id_ < 0) {
+            return;
+        }
+        // Assign new ids so that the children of each node are numbered consecutively
+        // and the subtree under each child follows before its next sibling's subtree.
+        std::vector<int> new_state_id(state_nodes_.size(), -1);
+        std::vector<int> new_distribution_id(distribution_nodes_.size(), -1);
+        std::vector<int> state_order;
+        std::vector<int> distribution_order;
+        std::vector<int> pending {initial_state_node_id_};
+        new_state_id[initial_state_node_id_] = 0;
+        state_order.push_back(initial_state_node_id_);
+        while(!pending.empty()) {
+            int old_state_id = pending.back();
+            pending.pop_back();
+            std::vector<int> new_children;
+            int old_expansion_id = state_nodes_[old_state_id].expansion_id;
+            if(old_expansion_id < 0) {
+                continue;
+            }
+            // Pruned children are kept after the active ones.
+            const StateNodeExpansion& old_expansion = state_expansions_[old_expansion_id];
+            for(auto* edges : {&old_expansion.next_distribution_nodes, &old_expansion.pruned_distribution_nodes}) {
+                for(auto& dist_edge : *edges) {
+                    int old_dist_id = dist_edge.distribution_node_id;
+                    if(new_distribution_id[old_dist_id] >= 0) {
+                        continue;
+                    }
+                    new_distribution_id[old_dist_id] = distribution_order.size();
+                    distribution_order.push_back(old_dist_id);
+                    for(auto& state_edge : distribution_nodes_[old_dist_id].next_state_nodes) {
+                        int child_id = state_edge.state_node_id;
+                        if(new_state_id[child_id] < 0) {
+                            new_state_id[child_id] = state_order.size();
+                            state_order.push_back(child_id);
+                            new_children.push_back(child_id);
+                        }
+                    }
+                }
+            }
+            // Reverse so that the first child is visited first.
+            pending.insert(pending.end(), new_children.rbegin(), new_children.rend());
+        }
+
+        // Move nodes into their new positions and rewrite ids in edges and indexes. Survivors
+        // are copied into a fresh arena so that memory held by dropped nodes is released.
+        TreeMemory compacted_memory;
+        std::vector<StateNode> compacted_state_nodes;
+        std::vector<StateNodeExpansion> compacted_expansions;
+        compacted_state_nodes.reserve(state_order.size());
+        state_to_node_id_.clear();
+        for(int old_id : state_order) {
+            int new_id = new_state_id[old_id];
+            StateNode node(state_nodes_[old_id], compacted_memory.resource());
+            if(node.expansion_id >= 0) {
+                StateNodeExpansion expansion(std::move(state_expansions_[node.expansion_id]), compacted_memory.resource());
+                expansion.clear_actuations();
+                for(auto* edges : {&expansion.next_distribution_nodes, &expansion.pruned_distribution_nodes}) {
+                    for(auto& edge : *edges) {
+                        edge.state_node_id = new_id;
+                        edge.distribution_node_id = new_distribution_id[edge.distribution_node_id];
+                        expansion.add_actuation(edge.distribution_node_id, to_double(edge.actuation));
+                    }
+                }
+                node.expansion_id = compacted_expansions.size();
+                compacted_expansions.push_back(std::move(expansion));
+                state_to_node_id_.add(new_id, to_double(node.state));
+            }
+            compacted_state_nodes.push_back(std::move(node));
+        }
+        std::vector<DistributionNode> compacted_distribution_nodes;
+        compacted_distribution_nodes.reserve(distribution_order.size());
+        for(int old_id : distribution_order) {
+            DistributionNode node(std::move(distribution_nodes_[old_id]), compacted_memory.resource());
+            node.node_id = new_distribution_id[old_id];
+            for(auto& edge : node.next_state_nodes) {
+                edge.distribution_node_id = node.node_id;
+                edge.state_node_id = new_state_id[edge.state_node_id];
+            }
+            compacted_distribution_nodes.push_back(std::move(node));
+        }
+        state_nodes_.swap(compacted_state_nodes);
+        distribution_nodes_.swap(compacted_distribution_nodes);
+        state_expansions_.swap(compacted_expansions);
+        // Old nodes must go before the arena they were allocated from.
+        compacted_state_nodes.clear();
+        compacted_distribution_nodes.clear();
+        compacted_expansions.clear();
+        tree_memory_.swap(compacted_memory);
+        state_stats_.reorder(state_order);
+        distribution_stats_.reorder(distribution_order);
+        initial_state_node_id_ = 0;
+    }
+
     void Context::ensure_consistent_state() {
         // initial state present
         if(this->initial_state_.empty()) {
@@ -150,15 +874,15 @@ namespace figurer {
             throw std::invalid_argument("Missing predict_fn");
         }
         // callback dimensions consistent (call each once)
-        double initial_value = this->value_fn_(this->initial_state_);
+        double initial_value = this->value_fn_(vector_view(this->initial_state_));
         if(initial_value > maxValueSoFar_) {
             maxValueSoFar_ = initial_value;
         }
         if(initial_value < minValueSoFar_) {
             minValueSoFar_ = initial_value;
         }
-        Distribution initial_policy = this->policy_fn_(this->initial_state_);
-        std::vector<double> example_actuation = initial_policy.sample();
+        Distribution initial_policy = this->policy_fn_(vector_view(this->initial_state_));
+        std::vector<double> example_actuation = random_sample(initial_policy);
         if(example_actuation.empty()) {
             throw std::invalid_argument("policy_fn yields empty actuation");
         }
@@ -166,8 +890,9 @@ namespace figurer {
             throw std::invalid_argument("policy_fn yields actuation of size " + std::to_string(example_actuation.size()) +
                                         " which doesn't match expected size " + std::to_string(this->actuation_size_));
         }
-        Distribution next_state_distribution = this->predict_fn_(this->initial_state_, example_actuation);
-        std::vector<double> example_next_state = next_state_distribution.sample();
+        Distribution next_state_distribution = this->predict_fn_(vector_view(this->initial_state_),
+                                                                 vector_view(example_actuation));
+        std::vector<double> example_next_state = random_sample(next_state_distribution);
         if(example_next_state.empty()) {
             throw std::invalid_argument("predict_fn yields empty state");
         }
@@ -176,16 +901,21 @@ namespace figurer {
                                         " which doesn't match expected size " + std::to_string(this->state_size_));
         }
         // initial state node exists and matches initial state (otherwise fix by creating initial node)
-        if(initial_state_node_id_ < 0 || node_id_to_state_node_[initial_state_node_id_].state != initial_state_) {
-            StateNode initial_node{};
-            initial_node.node_id = ++max_state_node_id_;
-            initial_node.state = initial_state_;
+        if(initial_state_node_id_ < 0 || !same_coordinates(state_nodes_.at(initial_state_node_id_).state, initial_state_)) {
+            StateNode initial_node(tree_memory_.resource());
+            initial_node.state = to_node_vector(initial_state_, tree_memory_.resource());
+            initial_node.level = 0;
             initial_node.direct_value = initial_value;
-            initial_node.value = initial_value;
-            initial_node.next_actuation_distribution = initial_policy;
-            node_id_to_state_node_[initial_node.node_id] = initial_node;
-            initial_state_node_id_ = initial_node.node_id;
+            // Reuse the policy already computed for validation.
+            initial_node.expansion_id = state_expansions_.size();
+            state_expansions_.emplace_back(proposal(initial_policy, 0), new_seed_sequence(), tree_memory_.resource());
+            initial_state_node_id_ = state_nodes_.size();
+            state_nodes_.push_back(std::move(initial_node));
+            state_stats_.add();
+            state_stats_.value[initial_state_node_id_] = initial_value;
             state_to_node_id_.add(initial_state_node_id_, initial_state_);
+            // Report the new root's best action even if it matches the old root's.
+            has_best_root_actuation_ = false;
         }
     }
 
@@ -210,7 +940,10 @@ namespace figurer {
     }
 
     void Context::refresh_state_node(int state_node_id) {
-        auto& this_node = node_id_to_state_node_.at(state_node_id);
+        FIGURER_TRACE_SCOPE("refresh_state_node");
+        const StateNode& this_node = state_nodes_.at(state_node_id);
+        StateNodeExpansion* expansion = this_node.expansion_id < 0 ? nullptr : &state_expansions_[this_node.expansion_id];
+        const NodeStatistics& child_stats = distribution_stats_;
         double max_value = 0.0;
         double min_value_plus_error = 0.0;
         double max_value_plus_error = 0.0;
@@ -220,14 +953,20 @@ namespace figurer {
         double min_value = 0.0;
         double max_value_minus_error = 0.0;
         int max_value_depth = 0;
+        int max_value_id = -1;
         int total_paths = 0;
-        for(auto& edge : this_node.next_distribution_nodes) {
-            auto& next_node = node_id_to_distribution_node_.at(edge.second.distribution_node_id);
-            if(total_paths == 0 || next_node.value > max_value) {
-                max_value = next_node.value;
-                max_value_depth = next_node.depth;
+        int best_edge_index = -1;
+        for(auto& edge : children(state_node_id)) {
+            int next_id = edge.distribution_node_id;
+            double next_value = child_stats.value[next_id];
+            double next_total_error = child_stats.total_error[next_id];
+            if(total_paths == 0 || next_value > max_value) {
+                max_value = next_value;
+                max_value_depth = child_stats.depth[next_id];
+                max_value_id = next_id;
+                best_edge_index = total_paths;
             }
-            double value_plus_error = next_node.value + next_node.total_error;
+            double value_plus_error = next_value + next_total_error;
             if(max_value_plus_error_id < 0 || value_plus_error < min_value_plus_error) {
                 min_value_plus_error = value_plus_error;
             }
@@ -235,25 +974,34 @@ namespace figurer {
                 second_max_value_plus_error = max_value_plus_error;
                 second_max_value_plus_error_id = max_value_plus_error_id;
                 max_value_plus_error = value_plus_error;
-                max_value_plus_error_id = next_node.node_id;
-            } else if(second_max_value_plus_error_id < 0 || next_node.value > max_value) {
+                max_value_plus_error_id = next_id;
+            } else if(second_max_value_plus_error_id < 0 || next_value > max_value) {
                 second_max_value_plus_error = value_plus_error;
-                second_max_value_plus_error_id = next_node.node_id;
+                second_max_value_plus_error_id = next_id;
             }
-            if(total_paths == 0 || next_node.value < min_value) {
-                min_value = next_node.value;
+            if(total_paths == 0 || next_value < min_value) {
+                min_value = next_value;
             }
-            double value_minus_error = next_node.value - next_node.total_error;
+            double value_minus_error = next_value - next_total_error;
             if(total_paths == 0 || value_minus_error > max_value_minus_error) {
                 max_value_minus_error = value_minus_error;
             }
             total_paths++;
         }
+        if(expansion) {
+            expansion->best_edge_index = best_edge_index;
+        }
         if(total_paths > 0) {
             // Calculate value error bars based on children only (will add direct value later).
             int this_depth = max_value_depth + 1;
-            double sparsity_error = total_paths < 2 ? default_sparsity_error_for_state_node() * this_depth / depth_
-                    : std::max(0.01, (max_value - min_value)) / total_paths;
+            // Pruned children still count as samples of the actuation space, even once freed.
+            int sampled_paths = total_paths + expansion->pruned_count;
+            double sparsity_error = sampled_paths < 2 ? default_sparsity_error_for_state_node() * this_depth / depth_
+                    : std::max(0.01, (max_value - min_value)) / sampled_paths;
+            // Children of a discrete policy that has tried every action cover all of its actuations.
+            if(expansion->discrete() && expansion->untried_action() < 0) {
+                sparsity_error = 0;
+            }
             double child_value_min = max_value_minus_error;
             double child_value_max1 = max_value_plus_error;
             double child_value_max2 = second_max_value_plus_error_id < 0 ? max_value_plus_error : second_max_value_plus_error;
@@ -266,26 +1014,46 @@ namespace figurer {
             double final_value_max = (this_node.direct_value + this_depth * child_value_max)
                                      / (this_depth + 1);
             double final_value = (final_value_min + final_value_max) * 0.5;
+            double child_error = final_value - final_value_min;
             // Record stats in node.
-            this_node.value = final_value;
-            this_node.depth = this_depth;
-            this_node.child_error = final_value - final_value_min;
-            this_node.sparsity_error = sparsity_error;
-            this_node.total_error = sqrt(pow(this_node.child_error,2.0) + pow(sparsity_error,2.0));
+            state_stats_.value[state_node_id] = final_value;
+            state_stats_.depth[state_node_id] = this_depth;
+            state_stats_.child_error[state_node_id] = child_error;
+            state_stats_.sparsity_error[state_node_id] = sparsity_error;
+            state_stats_.total_error[state_node_id] = sqrt(pow(child_error,2.0) + pow(sparsity_error,2.0));
             if(total_paths > 2 && state_node_id == initial_state_node_id_) {
                 rootSpread_ = max_value - min_value;
             }
+            if(pruning_margin_ >= 0 && total_paths > 1 && prune_dominated_children(*expansion, max_value_minus_error - pruning_margin_)) {
+                // The best child is never pruned, but it may have moved.
+                auto& edges = expansion->next_distribution_nodes;
+                expansion->best_edge_index = std::find_if(edges.begin(), edges.end(),
+                        [max_value_id](const StateDistributionEdge& edge) {
+                            return edge.distribution_node_id == max_value_id;
+                        }) - edges.begin();
+            }
+            if(state_node_id == initial_state_node_id_ && best_action_fn_) {
+                notify_if_best_action_changed();
+            }
+        } else if(this_node.rollout_steps > 0) {
+            state_stats_.value[state_node_id] = this_node.rollout_value;
+            state_stats_.depth[state_node_id] = this_node.rollout_steps;
+            state_stats_.child_error[state_node_id] = 0;
+            state_stats_.sparsity_error[state_node_id] = 0;
+            state_stats_.total_error[state_node_id] = 0;
         } else {
-            this_node.value = this_node.direct_value;
-            this_node.depth = 0;
-            this_node.child_error = 0;
-            this_node.sparsity_error = 0;
-            this_node.total_error = 0;
+            state_stats_.value[state_node_id] = this_node.direct_value;
+            state_stats_.depth[state_node_id] = 0;
+            state_stats_.child_error[state_node_id] = 0;
+            state_stats_.sparsity_error[state_node_id] = 0;
+            state_stats_.total_error[state_node_id] = 0;
         }
     }
 
     void Context::refresh_distribution_node(int distribution_node_id) {
-        auto& this_node = node_id_to_distribution_node_.at(distribution_node_id);
+        FIGURER_TRACE_SCOPE("refresh_distribution_node");
+        const DistributionNode& this_node = distribution_nodes_.at(distribution_node_id);
+        const NodeStatistics& child_stats = state_stats_;
         double total_value = 0.0;
         double min_child_value = 0.0;
         double max_child_value = 0.0;
@@ -293,18 +1061,18 @@ namespace figurer {
         int max_depth = 0;
         int total_paths = 0;
         for(auto& edge : this_node.next_state_nodes) {
-            auto& next_node = node_id_to_state_node_.at(edge.second.state_node_id);
-            double child_value = next_node.value;
+            int next_id = edge.state_node_id;
+            double child_value = child_stats.value[next_id];
             total_value += child_value;
-            total_child_error_squared += pow(next_node.total_error, 2.0);
+            total_child_error_squared += pow(child_stats.total_error[next_id], 2.0);
             if(total_paths == 0 || child_value < min_child_value) {
                 min_child_value = child_value;
             }
             if(total_paths == 0 || child_value > max_child_value) {
                 max_child_value = child_value;
             }
-            if(next_node.depth > max_depth) {
-                max_depth = next_node.depth;
+            if(child_stats.depth[next_id] > max_depth) {
+                max_depth = child_stats.depth[next_id];
             }
             total_paths++;
         }
@@ -315,11 +1083,11 @@ namespace figurer {
                 sparsity_error = default_sparsity_error_for_distribution_node();
             }
             double total_error = sqrt(pow(child_error, 2.0) + pow(sparsity_error, 2.0));
-            this_node.value = total_value / total_paths;
-            this_node.depth = max_depth;
-            this_node.child_error = child_error;
-            this_node.sparsity_error = sparsity_error;
-            this_node.total_error = total_error;
+            distribution_stats_.value[distribution_node_id] = total_value / total_paths;
+            distribution_stats_.depth[distribution_node_id] = max_depth;
+            distribution_stats_.child_error[distribution_node_id] = child_error;
+            distribution_stats_.sparsity_error[distribution_node_id] = sparsity_error;
+            distribution_stats_.total_error[distribution_node_id] = total_error;
             if(total_paths > 1) {
                 double low_sparsity_estimate = std::max(0.01, (total_error - child_error) * total_paths);
                 if(avg_dist_sparsity_ < 0) {
@@ -330,151 +1098,221 @@ namespace figurer {
             }
         } else {
             double sparsity_error = default_sparsity_error_for_distribution_node();
-            this_node.value = 0;
-            this_node.depth = 0;
-            this_node.child_error = 0;
-            this_node.sparsity_error = sparsity_error;
-            this_node.total_error = sparsity_error;
+            distribution_stats_.value[distribution_node_id] = 0;
+            distribution_stats_.depth[distribution_node_id] = 0;
+            distribution_stats_.child_error[distribution_node_id] = 0;
+            distribution_stats_.sparsity_error[distribution_node_id] = sparsity_error;
+            distribution_stats_.total_error[distribution_node_id] = sparsity_error;
+        }
+    }
+
+    StateNodeExpansion& Context::expand_state_node(int state_node_id) {
+        StateNode& state_node = state_nodes_.at(state_node_id);
+        if(state_node.expansion_id < 0) {
+            state_node.expansion_id = state_expansions_.size();
+            state_expansions_.emplace_back(proposal(policy(callback_coordinates(state_node.state)), state_node.level),
+                                           new_seed_sequence(), tree_memory_.resource());
+            state_to_node_id_.add(state_node_id, to_double(state_node.state));
         }
+        return state_expansions_[state_node.expansion_id];
+    }
+
+    const std::pmr::vector<StateDistributionEdge>& Context::children(int state_node_id) const {
+        static const std::pmr::vector<StateDistributionEdge> no_children;
+        int expansion_id = state_nodes_[state_node_id].expansion_id;
+        return expansion_id < 0 ? no_children : state_expansions_[expansion_id].next_distribution_nodes;
     }
 
     StateDistributionEdge Context::create_from_state_node(int state_node_id) {
-        auto& state_node = node_id_to_state_node_.at(state_node_id);
-        // Sample next actuation and resulting state distribution.
-        std::vector<double> actuation = state_node.next_actuation_distribution.sample();
-        Distribution next_state_distribution = this->predict_fn_(state_node.state, actuation);
+        FIGURER_TRACE_SCOPE("create_from_state_node");
+        StateNode& state_node = state_nodes_.at(state_node_id);
+        StateNodeExpansion& expansion = expand_state_node(state_node_id);
+        callback_coordinates state(state_node.state);
+        // Sample next actuation and resulting state distribution. Discrete policies try
+        // each action once, most likely first, instead of sampling.
+        std::vector<double> actuation = expansion.discrete()
+                ? std::vector<double>{(double) expansion.untried_action()}
+                : sample_node(expansion.next_actuation_distribution, expansion.actuation_seeds);
+        Distribution next_state_distribution = predict(state, vector_view(actuation));
 
         // Try to connect to nearby state instead of creating new
-        if(predict_inverse_fn_) {
-            auto next_state = next_state_distribution.sample();
-            auto nearby = state_to_node_id_.closest(next_state);
-            int nearby_state_node_id = nearby.first;
-            // Ensure nearby isn't already a child before continuing connection effort.
-            bool nearby_already_connected = false;
-            for(auto& child_dist_edge : state_node.next_distribution_nodes) {
-                auto& child_dist = node_id_to_distribution_node_.at(child_dist_edge.second.distribution_node_id);
+        if((predict_inverse_fn_ || predict_inverse_batch_fn_) && !expansion.discrete()) {
+            FIGURER_TRACE_SCOPE("aim");
+            auto next_state = random_sample(next_state_distribution);
+            std::vector<std::pair<int,std::vector<double>>> nearby_states;
+            if(aim_candidates_ > 1) {
+                nearby_states = state_to_node_id_.closest_k(next_state, aim_candidates_);
+            } else {
+                nearby_states.push_back(state_to_node_id_.closest(next_state));
+            }
+            // Grandchildren are already reachable, so aiming at them adds nothing.
+            std::vector<int> connected_state_node_ids;
+            for(auto& child_dist_edge : expansion.next_distribution_nodes) {
+                auto& child_dist = distribution_nodes_[child_dist_edge.distribution_node_id];
                 for(auto& child_state_edge : child_dist.next_state_nodes) {
-                    if(nearby_state_node_id == child_state_edge.second.state_node_id) {
-                        nearby_already_connected = true;
-                    }
+                    connected_state_node_ids.push_back(child_state_edge.state_node_id);
                 }
             }
-            if(! nearby_already_connected) {
-                auto aim_actuation = predict_inverse_fn_(state_node.state, nearby.second);
-                Distribution aim_state_dist = predict_fn_(state_node.state, aim_actuation);
-                auto aim_state_sample = aim_state_dist.sample();
+            nearby_states.erase(std::remove_if(nearby_states.begin(), nearby_states.end(),
+                    [&connected_state_node_ids](const std::pair<int,std::vector<double>>& nearby) {
+                        return std::find(connected_state_node_ids.begin(), connected_state_node_ids.end(),
+                                         nearby.first) != connected_state_node_ids.end();
+                    }), nearby_states.end());
+            // Aim at every remaining target with one inverse model call.
+            std::vector<vector_view> targets;
+            for(auto& nearby : nearby_states) {
+                targets.emplace_back(nearby.second);
+            }
+            std::vector<std::vector<double>> aim_actuations;
+            predict_inverse(state, targets, aim_actuations);
+            // Predict the outcomes of all aimed actuations with one forward model call.
+            std::vector<vector_view> aim_views(aim_actuations.begin(), aim_actuations.end());
+            std::vector<Distribution> aim_state_dists;
+            predict(state, aim_views, aim_state_dists);
+            double next_policy_density = -1;
+            double next_actuation_distance = 1.0;
+            bool aimed = false;
+            double best_score = 0;
+            std::vector<double> best_actuation;
+            for(size_t target = 0; target < nearby_states.size(); target++) {
+                auto& nearby = nearby_states[target];
+                std::vector<double>& aim_actuation = aim_actuations[target];
+                Distribution& aim_state_dist = aim_state_dists[target];
+                auto aim_state_sample = random_sample(aim_state_dist);
                 double old_distance2 = distance2(next_state, nearby.second);
                 double aim_distance2 = distance2(aim_state_sample, nearby.second);
-                // If aiming can't get us at least 5x closer then don't bother.
-                if(aim_distance2 < 0.04 * old_distance2) {
-                    double next_policy_density = state_node.next_actuation_distribution.density(actuation);
-                    double aim_policy_density = state_node.next_actuation_distribution.density(aim_actuation);
-                    double next_actuation_distance = 1.0;
-                    double aim_actuation_distance = 1.0;
-                    if(!state_node.next_distribution_nodes.empty()) {
-                        next_actuation_distance = state_node.actuations_so_far.closest_distance(actuation);
-                        aim_actuation_distance = state_node.actuations_so_far.closest_distance(aim_actuation);
-                    }
-                    // Aim version is allowed to be up to 5x worse in combination of policy density
-                    // and distance from other actuations.
-                    if(aim_policy_density * next_actuation_distance > 0.2 * next_policy_density * aim_actuation_distance) {
-                        // Finalize decision to aim by replacing actuation and state distribution with aim versions.
-                        actuation = aim_actuation;
-                        next_state_distribution = aim_state_dist;
-                        //std::cout << "State" << state_node_id << " created dist" << this->max_distribution_node_id_ + 1
-                        //          << " to aim at state" << nearby_state_node_id << std::endl;
+                // If aiming doesn't get much closer (5x by default) then don't bother.
+                if(aim_distance2 >= aim_distance_ratio_ * old_distance2) {
+                    continue;
+                }
+                if(next_policy_density < 0) {
+                    next_policy_density = expansion.next_actuation_distribution.density(actuation);
+                    if(!expansion.next_distribution_nodes.empty()) {
+                        next_actuation_distance = expansion.closest_actuation_distance(actuation);
                     }
                 }
+                double aim_policy_density = expansion.next_actuation_distribution.density(aim_actuation);
+                double aim_actuation_distance = 1.0;
+                if(!expansion.next_distribution_nodes.empty()) {
+                    aim_actuation_distance = expansion.closest_actuation_distance(aim_actuation);
+                }
+                // Score actuations by policy density times distance from sibling actuations, so that
+                // likely actuations far from existing siblings score highest. Aim version is allowed
+                // to score somewhat worse (5x by default) and the best scoring target wins.
+                double aim_score = aim_policy_density * aim_actuation_distance;
+                if(aim_score <= aim_score_ratio_ * next_policy_density * next_actuation_distance) {
+                    continue;
+                }
+                if(!aimed || aim_score > best_score) {
+                    aimed = true;
+                    best_score = aim_score;
+                    // Replace actuation and state distribution with aim versions.
+                    best_actuation.swap(aim_actuation);
+                    next_state_distribution = aim_state_dist;
+                }
+            }
+            if(aimed) {
+                actuation = best_actuation;
+                aimed_expansions_++;
             }
         }
 
         // Create node and edge for new distribution node.
-        int next_distribution_node_id = ++this->max_distribution_node_id_;
-        StateDistributionEdge next_state_distribution_edge{};
-        next_state_distribution_edge.state_node_id = state_node_id;
-        next_state_distribution_edge.distribution_node_id = next_distribution_node_id;
-        next_state_distribution_edge.actuation = actuation;
-        DistributionNode next_distribution_node{};
+        int next_distribution_node_id = distribution_nodes_.size();
+        DistributionNode next_distribution_node(tree_memory_.resource());
         next_distribution_node.node_id = next_distribution_node_id;
+        next_distribution_node.level = state_node.level;
         next_distribution_node.next_state_distribution = next_state_distribution;
-        next_distribution_node.value = state_node.value;
-        next_distribution_node.depth = 0;
+        next_distribution_node.state_seeds = new_seed_sequence();
         // Add node and edge to context and return edge.
-        node_id_to_distribution_node_.emplace(next_distribution_node_id, next_distribution_node);
-        state_node.next_distribution_nodes.emplace(next_distribution_node.node_id, next_state_distribution_edge);
-        state_node.actuations_so_far.add(next_distribution_node_id,actuation);
-        return next_state_distribution_edge;
+        distribution_nodes_.push_back(std::move(next_distribution_node));
+        distribution_stats_.add();
+        distribution_stats_.value[next_distribution_node_id] = state_stats_.value[state_node_id];
+        // Construct in place so that the actuation is allocated from tree memory.
+        expansion.next_distribution_nodes.push_back(StateDistributionEdge{
+                state_node_id, next_distribution_node_id, to_node_vector(actuation, tree_memory_.resource())});
+        expansion.add_actuation(next_distribution_node_id,actuation);
+        return expansion.next_distribution_nodes.back();
     }
 
     StateDistributionEdge Context::create_or_explore_from_state_node(int state_node_id) {
-        auto& state_node = node_id_to_state_node_.at(state_node_id);
+        int expansion_id = state_nodes_.at(state_node_id).expansion_id;
+        if(expansion_id < 0) {
+            return create_from_state_node(state_node_id);
+        }
+        const StateNodeExpansion& expansion = state_expansions_[expansion_id];
+        // Once every discrete action has a child there is nothing new to create.
+        bool actions_exhausted = expansion.discrete() && expansion.untried_action() < 0;
         // Force some variety so that sparcity error can be estimated accurately.
-        if(state_node.next_distribution_nodes.size() < 3) {
+        if(!actions_exhausted && expansion.next_distribution_nodes.size() + expansion.pruned_count < 3) {
             return create_from_state_node(state_node_id);
         }
         // If sparcity error dominates then address that problem with new node.
-        if(state_node.sparsity_error > state_node.child_error) {
+        if(!actions_exhausted && state_stats_.sparsity_error[state_node_id] > state_stats_.child_error[state_node_id]) {
             return create_from_state_node(state_node_id);
         }
         // Otherwise refine the most promising child node.
         double max_value_plus_error = 0;
-        int max_value_plus_error_id = -1;
-        for(auto& edge : state_node.next_distribution_nodes) {
-            auto& next_node = node_id_to_distribution_node_.at(edge.second.distribution_node_id);
-            double value_plus_error = next_node.value + next_node.total_error;
-            if(max_value_plus_error_id < 0 || value_plus_error > max_value_plus_error) {
-                max_value_plus_error_id = next_node.node_id;
+        int max_value_plus_error_index = -1;
+        for(size_t e = 0; e < expansion.next_distribution_nodes.size(); e++) {
+            int next_id = expansion.next_distribution_nodes[e].distribution_node_id;
+            double value_plus_error = distribution_stats_.value[next_id] + distribution_stats_.total_error[next_id];
+            if(max_value_plus_error_index < 0 || value_plus_error > max_value_plus_error) {
+                max_value_plus_error_index = e;
                 max_value_plus_error = value_plus_error;
             }
         }
-        return state_node.next_distribution_nodes.at(max_value_plus_error_id);
+        return expansion.next_distribution_nodes[max_value_plus_error_index];
     }
 
     DistributionStateEdge Context::create_from_distribution_node(int distribution_node_id) {
+        FIGURER_TRACE_SCOPE("create_from_distribution_node");
         // Sample state distribution to determine next state, then create next state node.
-        auto& distribution_node = node_id_to_distribution_node_.at(distribution_node_id);
-        std::vector<double> state = distribution_node.next_state_distribution.sample();
+        DistributionNode& distribution_node = distribution_nodes_.at(distribution_node_id);
+        std::vector<double> state = sample_node(distribution_node.next_state_distribution, distribution_node.state_seeds);
         double sample_density = distribution_node.next_state_distribution.density(state);
         DistributionStateEdge distribution_state_edge{};
         distribution_state_edge.distribution_node_id = distribution_node_id;
 
         // Try to connect to nearby state instead of creating new
         auto nearby = state_to_node_id_.closest(state);
-        if(distribution_node.next_state_nodes.find(nearby.first) == distribution_node.next_state_nodes.end()) {
+        bool nearby_already_connected = std::any_of(
+                distribution_node.next_state_nodes.begin(), distribution_node.next_state_nodes.end(),
+                [&nearby](const DistributionStateEdge& edge) { return edge.state_node_id == nearby.first; });
+        if(!nearby_already_connected) {
             double nearby_density = distribution_node.next_state_distribution.density(nearby.second);
             if(nearby_density > 0.1 * sample_density) {
                 distribution_state_edge.state_node_id = nearby.first;
                 distribution_state_edge.density = nearby_density;
-                distribution_node.next_state_nodes.emplace(nearby.first, distribution_state_edge);
+                distribution_node.next_state_nodes.push_back(distribution_state_edge);
                 //std::cout << "Distribution node " << distribution_node_id << " connecting to existing state node " << nearby.first << std::endl;
                 return distribution_state_edge;
             }
         }
 
-        int state_node_id = ++this->max_state_node_id_;
+        int state_node_id = state_nodes_.size();
         distribution_state_edge.state_node_id = state_node_id;
         distribution_state_edge.density = sample_density;
-        StateNode state_node{};
-        state_node.node_id = state_node_id;
-        state_node.state = state;
-        state_node.next_actuation_distribution = this->policy_fn_(state);
-        state_node.direct_value = this->value_fn_(state);
-        state_node.value = state_node.direct_value;
-        state_node.depth = 0;
-        node_id_to_state_node_.emplace(state_node_id, state_node);
-        distribution_node.next_state_nodes.emplace(state_node_id, distribution_state_edge);
-        state_to_node_id_.add(state_node_id, state);
-        if(state_node.direct_value > maxValueSoFar_) {
-            maxValueSoFar_ = state_node.direct_value;
-        }
-        if(state_node.direct_value < minValueSoFar_) {
-            minValueSoFar_ = state_node.direct_value;
+        StateNode state_node(tree_memory_.resource());
+        state_node.level = distribution_node.level + 1;
+        state_node.state = to_node_vector(state, tree_memory_.resource());
+        state_node.direct_value = value(vector_view(state));
+        double direct_value = state_node.direct_value;
+        state_nodes_.push_back(std::move(state_node));
+        state_stats_.add();
+        state_stats_.value[state_node_id] = direct_value;
+        distribution_node.next_state_nodes.push_back(distribution_state_edge);
+        if(direct_value > maxValueSoFar_) {
+            maxValueSoFar_ = direct_value;
+        }
+        if(direct_value < minValueSoFar_) {
+            minValueSoFar_ = direct_value;
         }
         return distribution_state_edge;
     }
 
     DistributionStateEdge Context::create_or_explore_from_distribution_node(int distribution_node_id) {
-        auto& distribution_node = node_id_to_distribution_node_.at(distribution_node_id);
+        const DistributionNode& distribution_node = distribution_nodes_.at(distribution_node_id);
         // If no children then creating is the only option.
         if(distribution_node.next_state_nodes.empty()) {
             return create_from_distribution_node(distribution_node_id);
@@ -482,30 +1320,58 @@ namespace figurer {
         // If less than 2 children, sparsity error was set by default.
         // Better to use current default that is based on more data.
         double sparsity_error = distribution_node.next_state_nodes.size() < 2 ?
-                default_sparsity_error_for_distribution_node() : distribution_node.sparsity_error;
+                default_sparsity_error_for_distribution_node() : distribution_stats_.sparsity_error[distribution_node_id];
         // If sparcity error dominates then address that problem with new node.
-        if(sparsity_error > distribution_node.child_error) {
+        if(sparsity_error > distribution_stats_.child_error[distribution_node_id]) {
             return create_from_distribution_node(distribution_node_id);
         }
         // Otherwise refine the most promising child node.
         double max_value_plus_error = 0;
-        int max_value_plus_error_id = -1;
-        for(auto& edge : distribution_node.next_state_nodes) {
-            auto& next_node = node_id_to_state_node_.at(edge.second.state_node_id);
-            double value_plus_error = next_node.value + next_node.total_error;
-            if(max_value_plus_error_id < 0 || value_plus_error > max_value_plus_error) {
-                max_value_plus_error_id = next_node.node_id;
+        int max_value_plus_error_index = -1;
+        for(size_t e = 0; e < distribution_node.next_state_nodes.size(); e++) {
+            int next_id = distribution_node.next_state_nodes[e].state_node_id;
+            double value_plus_error = state_stats_.value[next_id] + state_stats_.total_error[next_id];
+            if(max_value_plus_error_index < 0 || value_plus_error > max_value_plus_error) {
+                max_value_plus_error_index = e;
                 max_value_plus_error = value_plus_error;
             }
         }
-        return distribution_node.next_state_nodes.at(max_value_plus_error_id);
+        return distribution_node.next_state_nodes[max_value_plus_error_index];
+    }
+
+    void Context::rollout(int state_node_id, int steps) {
+        FIGURER_TRACE_SCOPE("rollout");
+        // Simulate forward without creating nodes, then fold values back in the same way
+        // that refresh_state_node combines a node's direct value with its children.
+        std::vector<double> state = to_double(state_nodes_[state_node_id].state);
+        std::vector<double> direct_values;
+        for(int step = 0; step < steps; step++) {
+            std::vector<double> actuation;
+            if(rollout_fn_) {
+                FIGURER_TRACE_SCOPE("rollout_fn");
+                rollout_fn_(vector_view(state), actuation);
+            } else {
+                actuation = policy(vector_view(state)).central_sample();
+            }
+            state = predict(vector_view(state), vector_view(actuation)).central_sample();
+            direct_values.push_back(value(vector_view(state)));
+        }
+        double value = direct_values.back();
+        for(int height = 1; height < steps; height++) {
+            value = (direct_values[steps - 1 - height] + height * value) / (height + 1);
+        }
+        StateNode& node = state_nodes_[state_node_id];
+        node.rollout_value = (node.direct_value + steps * value) / (steps + 1);
+        node.rollout_steps = steps;
     }
 
     void Context::figure_once() {
+        FIGURER_TRACE_SCOPE("figure_once");
+        int tree_depth = rollout_depth_ >= 0 ? std::min(rollout_depth_, depth_) : depth_;
         int current_state_node_id = initial_state_node_id_;
         std::vector<int> visited_state_nodes {current_state_node_id};
         std::vector<int> visited_distribution_nodes;
-        for(int depth = 0; depth < this->depth_; depth++) {
+        for(int depth = 0; depth < tree_depth; depth++) {
             // Create new nodes or refine existing nodes
             StateDistributionEdge state_distribution_edge = create_or_explore_from_state_node(current_state_node_id);
             DistributionStateEdge distribution_state_edge = create_or_explore_from_distribution_node(state_distribution_edge.distribution_node_id);
@@ -516,11 +1382,22 @@ namespace figurer {
             visited_distribution_nodes.push_back(state_distribution_edge.distribution_node_id);
             visited_state_nodes.push_back(distribution_state_edge.state_node_id);
         }
+        // Estimate the rest of the lookahead from the frontier node, once per node.
+        const StateNode& frontier = state_nodes_[current_state_node_id];
+        if(tree_depth < depth_ && children(current_state_node_id).empty() && frontier.rollout_steps == 0) {
+            rollout(current_state_node_id, depth_ - tree_depth);
+            refresh_state_node(current_state_node_id);
+        }
         // Update value for all visited nodes.
-        for(int depth = this->depth_ - 1; depth >= 0; depth--) {
+        for(int depth = tree_depth - 1; depth >= 0; depth--) {
+            distribution_stats_.visits[visited_distribution_nodes[depth]]++;
             refresh_distribution_node(visited_distribution_nodes[depth]);
+            state_stats_.visits[visited_state_nodes[depth]]++;
             refresh_state_node(visited_state_nodes[depth]);
         }
+        if(compaction_interval_ > 0 && ++iterations_since_compaction_ >= compaction_interval_) {
+            compact();
+        }
     }
 
     std::ostream &operator<<(std::ostream &os, const figurer::Context &context) {
@@ -528,7 +1405,9 @@ namespace figurer {
         std::streamsize oldprecision = os.precision();
         os << std::fixed << std::setprecision(2);
         os << "\n<Figurer::Context>\n";
-        const figurer::StateNode &root = context.node_id_to_state_node_.at(context.initial_state_node_id_);
+        int root_id = context.initial_state_node_id_;
+        const figurer::StateNode &root = context.state_nodes_.at(root_id);
+        const figurer::NodeStatistics &stats = context.state_stats_;
         os << "    initial: ";
         for (int i = 0; i < root.state.size(); i++) {
             if (i > 0) {
@@ -536,12 +1415,12 @@ namespace figurer {
             }
             os << root.state[i];
         }
-        os << "\n    value: " << root.value << " +/- " << root.total_error;
-        os << "\n    sparsity: " << root.sparsity_error;
-        os << "\n    children: " << root.next_distribution_nodes.size();
+        os << "\n    value: " << stats.value[root_id] << " +/- " << stats.total_error[root_id];
+        os << "\n    sparsity: " << stats.sparsity_error[root_id];
+        os << "\n    children: " << context.children(root_id).size();
         os << "\n\n";
-        for (auto &edge : root.next_distribution_nodes) {
-            context.showStateDistEdge(os, edge.second, 2);
+        for (auto &edge : context.children(root_id)) {
+            context.showStateDistEdge(os, edge, 2);
         }
 
         os << std::endl;
@@ -551,11 +1430,12 @@ namespace figurer {
     }
 
     void Context::showStateDistEdge(std::ostream& os, const StateDistributionEdge& edge, int indent) const {
-        auto &dist_node = node_id_to_distribution_node_.at(edge.distribution_node_id);
+        int dist_id = edge.distribution_node_id;
+        auto &dist_node = distribution_nodes_.at(dist_id);
         for (int i = 0; i < indent; i++) {
             os << "    ";
         }
-        os << "dist" << edge.distribution_node_id;
+        os << "dist" << dist_id;
         os << "  act: ";
         for (int i = 0; i < edge.actuation.size(); i++) {
             if (i > 0) {
@@ -563,33 +1443,34 @@ namespace figurer {
             }
             os << edge.actuation[i];
         }
-        os << "  value: " << dist_node.value << " +/- " << dist_node.total_error
-           << " (sparsity: " << dist_node.sparsity_error << ")";
+        os << "  value: " << distribution_stats_.value[dist_id] << " +/- " << distribution_stats_.total_error[dist_id]
+           << " (sparsity: " << distribution_stats_.sparsity_error[dist_id] << ")";
         os << "\n";
         for (auto &next_edge : dist_node.next_state_nodes) {
-            showDistStateEdge(os, next_edge.second, indent + 1);
+            showDistStateEdge(os, next_edge, indent + 1);
         }
     }
 
     void Context::showDistStateEdge(std::ostream& os, const DistributionStateEdge& edge, int indent) const {
-        auto &state_node = node_id_to_state_node_.at(edge.state_node_id);
+        int state_id = edge.state_node_id;
+        auto &state_node = state_nodes_.at(state_id);
         for(int i = 0; i < indent; i++) {
             os << "    ";
         }
-        os << "state" << edge.state_node_id << "  ";
+        os << "state" << state_id << "  ";
         for (int i = 0; i < state_node.state.size(); i++) {
             if (i > 0) {
                 os << ", ";
             }
             os << state_node.state[i];
         }
-        os << "  value: " << state_node.value << " +/- " << state_node.total_error
-           << " (sparsity: " << state_node.sparsity_error << ")";
+        os << "  value: " << state_stats_.value[state_id] << " +/- " << state_stats_.total_error[state_id]
+           << " (sparsity: " << state_stats_.sparsity_error[state_id] << ")";
 
         if (indent < depth_*2) {
             os << "\n";
-            for (auto &next_edge : state_node.next_distribution_nodes) {
-                showStateDistEdge(os, next_edge.second, indent + 1);
+            for (auto &next_edge : children(state_id)) {
+                showStateDistEdge(os, next_edge, indent + 1);
             }
         } else {
             os << " ...\n";
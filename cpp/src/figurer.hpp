@@ -1,10 +1,17 @@
 #ifndef FIGURER_HPP
 #define FIGURER_HPP
 
+#include "figurer_callback_cache.hpp"
 #include "figurer_distribution.hpp"
+#include "figurer_precision.hpp"
+#include "figurer_quasi_random.hpp"
 #include "figurer_spatial_index.hpp"
+#include "figurer_vector_view.hpp"
+#include <cstddef>
 #include <functional>
-#include <unordered_map>
+#include <memory>
+#include <random>
+#include <type_traits>
 #include <vector>
 
 namespace figurer {
@@ -14,102 +21,466 @@ namespace figurer {
         std::vector<std::vector<double>> actuations;
     };
 
+    // Search statistics for one child of the root.
+    struct RootAction {
+        std::vector<double> actuation;
+        double value;
+        double total_error;
+        int visits;
+    };
+
+    struct SearchStats {
+        long policy_cache_hits;
+        long policy_cache_misses;
+        long predict_cache_hits;
+        long predict_cache_misses;
+        int state_nodes;
+        int expanded_state_nodes;
+        int distribution_nodes;
+        // Approximate state lookups checked against an exact scan, and how many matched.
+        long neighbor_recall_samples;
+        long neighbor_recall_hits;
+        // Child branches moved out of the active set because a sibling dominated them.
+        long pruned_branches;
+        // New actuations replaced by one aimed at an existing state node.
+        long aimed_expansions;
+        // Bytes held by the arena for node coordinates and edges.
+        size_t tree_memory_bytes;
+    };
+
+    enum class StopReason {
+        // Best root action's lower bound is above every other root action's upper bound.
+        ActionSeparated,
+        // Root total error fell below the requested threshold.
+        ErrorThreshold,
+        IterationLimit,
+        TimeLimit
+    };
+
+    struct StopCriteria {
+        // Stop when root total error falls below this. Negative disables.
+        double root_error_threshold = -1;
+        // Stop when the best root action is separated from all others by its error bars.
+        bool stop_on_action_separation = true;
+        // Treat another action as separated if its upper bound is at most this much
+        // above the best action's lower bound. With continuous actions there are usually
+        // near duplicates of the best action, so some tolerance is needed in practice.
+        double separation_margin = 0;
+        // Upper limits on work. Negative disables, but at least one must be set.
+        double max_seconds = -1;
+        int max_iterations = -1;
+    };
+
+    struct FigureResult {
+        StopReason reason;
+        int iterations;
+        double seconds;
+    };
+
     struct StateDistributionEdge {
         int state_node_id;
         int distribution_node_id;
-        std::vector<double> actuation;
+        node_vector actuation;
     };
 
     struct DistributionStateEdge {
         int distribution_node_id;
         int state_node_id;
-        double density;
+        real_t density;
     };
 
-    struct StateNode {
-        int node_id;
-        std::vector<double> state;
+    // Data only needed once a state node is expanded. Most nodes are leaves
+    // that are never expanded, so this is created on first expansion.
+    struct StateNodeExpansion {
         Distribution next_actuation_distribution;
         spatial_index actuations_so_far;
-        double direct_value;
-        double value;
-        double child_error;
-        double sparsity_error;
-        double total_error;
-        int depth;
-        std::unordered_map<int,StateDistributionEdge> next_distribution_nodes;
+        // Seeds for successive actuation samples when quasi-random sampling is on.
+        halton_sequence actuation_seeds;
+        // Discrete policies index children by action id instead of actuations_so_far.
+        // -1 for actions without a child.
+        std::vector<int> action_children;
+        // Actions that have ever had a child. Unlike action_children this survives
+        // clear_actuations, so actions whose branches were pruned and freed aren't retried.
+        std::vector<bool> tried_actions;
+        // Hybrid policies index only continuous coordinates, separately for each action.
+        std::vector<spatial_index> action_actuations;
+
+        // Index in next_distribution_nodes of the child with the highest value as of
+        // the last refresh, or -1 if there are no children.
+        int best_edge_index;
+        std::pmr::vector<StateDistributionEdge> next_distribution_nodes;
+        // Children dominated by a sibling. Kept so the subtree survives compaction,
+        // but no longer scanned on each visit.
+        std::pmr::vector<StateDistributionEdge> pruned_distribution_nodes;
+        // Children pruned so far, including those freed with free_pruned.
+        int pruned_count;
+
+        // Edge lists are allocated from memory.
+        StateNodeExpansion(Distribution distribution, halton_sequence seeds,
+                           std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+        // Takes over other, copying its edges into memory.
+        StateNodeExpansion(StateNodeExpansion&& other, std::pmr::memory_resource* memory);
+        // Copy of other with edges allocated from memory.
+        StateNodeExpansion(const StateNodeExpansion& other, std::pmr::memory_resource* memory);
+        // Policy is purely discrete, so children can be enumerated exactly.
+        bool discrete() const;
+        // Most likely action without a child, or -1 if every possible action has been tried.
+        int untried_action() const;
+        void add_actuation(int distribution_node_id, const std::vector<double>& actuation);
+        void clear_actuations();
+        // Distance to the closest recorded actuation, comparing only actuations with the
+        // same action for hybrid policies. 1 if there is none to compare with.
+        double closest_actuation_distance(const std::vector<double>& actuation);
+    };
+
+    // Cold per-node data. Statistics read on every descent and backprop live in
+    // NodeStatistics instead, indexed by the same node id. Most state nodes stay
+    // leaves, so children are kept apart in a StateNodeExpansion.
+    struct StateNode {
+        // Steps from the root when the node was created. Nodes reused from another
+        // branch keep their original level.
+        int level;
+        // Index into the expansions, or -1 for a leaf.
+        int expansion_id;
+        real_t direct_value;
+        // Value and number of steps simulated beyond the tree frontier. Zero steps if no rollout.
+        real_t rollout_value;
+        int rollout_steps;
+        node_vector state;
+        StateNode() = default;
+        // Leaf whose coordinates are allocated from memory.
+        explicit StateNode(std::pmr::memory_resource* memory);
+        // Copy of other with coordinates allocated from memory.
+        StateNode(const StateNode& other, std::pmr::memory_resource* memory);
     };
 
     struct DistributionNode {
         int node_id;
+        // Level of the state node it was created from.
+        int level;
         Distribution next_state_distribution;
-        double value;
-        double child_error;
-        double sparsity_error;
-        double total_error;
-        int depth;
-        std::unordered_map<int,DistributionStateEdge> next_state_nodes;
+        // Seeds for successive state samples when quasi-random sampling is on.
+        halton_sequence state_seeds;
+        std::pmr::vector<DistributionStateEdge> next_state_nodes;
+        DistributionNode() = default;
+        explicit DistributionNode(std::pmr::memory_resource* memory);
+        // Takes over other, copying its edges into memory.
+        DistributionNode(DistributionNode&& other, std::pmr::memory_resource* memory);
+        // Copy of other with edges allocated from memory.
+        DistributionNode(const DistributionNode& other, std::pmr::memory_resource* memory);
     };
 
-    class Context {
+    // Arena for node coordinates and the edge lists of nodes and expansions. Allocation
+    // only bumps a pointer and release frees everything at once. Node records, their
+    // distributions and expansion indexes still come from the heap. Copies get a fresh arena.
+    class TreeMemory {
+        class counting_resource;
+        // Declared first so that the arena is destroyed before the memory under it.
+        std::unique_ptr<counting_resource> upstream_;
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> resource_;
+    public:
+        TreeMemory();
+        TreeMemory(const TreeMemory& other);
+        TreeMemory& operator=(const TreeMemory& other);
+        // Takes over other's arena, along with the nodes allocated from it, and leaves
+        // other a fresh one.
+        TreeMemory(TreeMemory&& other);
+        ~TreeMemory();
+        std::pmr::memory_resource* resource() const;
+        // Bytes the arena currently holds from the system, used or not.
+        size_t bytes() const;
+        // All nodes allocated from this arena must be destroyed first.
+        void release();
+        // Exchange arenas. Nodes stay in the arena they were allocated from.
+        void swap(TreeMemory& other);
+    };
+
+    // Nodes together with the arena they are allocated from. Copies rebuild every node
+    // in the copy's own arena. Moves take the arena along with the nodes and leave an
+    // empty tree behind.
+    class TreeStorage {
+    protected:
+        // Declared before the nodes so that it outlives them.
+        TreeMemory tree_memory_;
+        // Nodes are indexed by node id.
+        std::vector<StateNode> state_nodes_;
+        std::vector<DistributionNode> distribution_nodes_;
+        // Indexed by StateNode::expansion_id.
+        std::vector<StateNodeExpansion> state_expansions_;
+        // -1 until the root is created.
+        int initial_state_node_id_;
+        TreeStorage();
+        TreeStorage(const TreeStorage& other);
+        TreeStorage(TreeStorage&& other);
+        TreeStorage& operator=(const TreeStorage& other);
+        TreeStorage& operator=(TreeStorage&& other);
+        ~TreeStorage() = default;
+        void swap(TreeStorage& other);
+    };
+
+    // Hot statistics stored as structure-of-arrays so that scanning the children
+    // of a node touches a few contiguous ranges rather than whole nodes.
+    struct NodeStatistics {
+        std::vector<real_t> value;
+        std::vector<real_t> child_error;
+        std::vector<real_t> sparsity_error;
+        std::vector<real_t> total_error;
+        std::vector<int> depth;
+        // Number of times backprop passed through the node.
+        std::vector<int> visits;
+        // Append zeroed statistics for a new node.
+        void add();
+        // Remove all entries, keeping capacity.
+        void clear();
+        // Reorder so that entry i comes from old entry order[i].
+        void reorder(const std::vector<int>& order);
+    };
+
+    class Context : private TreeStorage {
         // Number of elements in state vector. Set to -1 to skip validation.
         int state_size_;
         // Number of elements in actuation vector. Set to -1 to skip validation.
         int actuation_size_;
         // Depth of lookahead
         int depth_;
+        // Depth at which tree growth stops and rollouts simulate the rest of the lookahead.
+        // Negative to grow the tree to the full depth.
+        int rollout_depth_;
+        // rollout: (state)->actuation. Uses the center of the policy distribution if not set.
+        std::function<void(vector_view,std::vector<double>&)> rollout_fn_;
+        void rollout(int state_node_id, int steps);
         std::vector<double> initial_state_;
         // These are used to estimate error in some edge cases.
         double rootSpread_, maxValueSoFar_, minValueSoFar_, avg_dist_sparsity_;
-        // Spatial index to find nearby state nodes
+        // Spatial index to find nearby expanded state nodes
         spatial_index state_to_node_id_;
         // value: (state)->value
-        std::function<double(std::vector<double>)> value_fn_;
+        std::function<double(vector_view)> value_fn_;
         // policy: (state)->actuation dist
-        std::function<Distribution(std::vector<double>)> policy_fn_;
+        std::function<Distribution(vector_view)> policy_fn_;
         // predict: (state,actuation)->state dist
-        std::function<Distribution(std::vector<double>,std::vector<double>)> predict_fn_;
+        std::function<Distribution(vector_view,vector_view)> predict_fn_;
         // predict inverse: (state1,state2)->actuation
         // What actuation should be used from state1 if the goal is to reach state2?
         // If state2 is not feasible or if the process is non-deterministic, then
         // actuation should be selected to come as close as possible.
-        std::function<std::vector<double>(std::vector<double>,std::vector<double>)> predict_inverse_fn_;
+        // Writes the actuation into the supplied buffer.
+        std::function<void(vector_view,vector_view,std::vector<double>&)> predict_inverse_fn_;
+        // predict inverse for many targets: (state1,targets)->actuations, one per target.
+        std::function<void(vector_view,const std::vector<vector_view>&,std::vector<std::vector<double>>&)>
+                predict_inverse_batch_fn_;
+        // predict for many actuations from one state: (state,actuations)->state dists, one per actuation.
+        std::function<void(vector_view,const std::vector<vector_view>&,std::vector<Distribution>&)> predict_batch_fn_;
+        // Optional memoisation of policy_fn and predict_fn keyed by quantised inputs.
+        callback_cache<Distribution> policy_cache_;
+        callback_cache<Distribution> predict_cache_;
+        // Previous plan shifted by one step, used as a prior on actuations at each level.
+        std::vector<std::vector<double>> prior_actuations_;
+        double prior_weight_;
+        double prior_spread_;
+        bool quasi_random_;
+        // Every random choice in the search and in sample_plan comes from here, so a
+        // context's searches are repeatable and don't depend on other users of rand().
+        std::mt19937 random_;
+        // Sample with a seed drawn from random_.
+        std::vector<double> random_sample(Distribution& distribution);
+        // Draw the next sample for a node from its own seed sequence, or from random_.
+        std::vector<double> sample_node(Distribution& distribution, halton_sequence& seeds);
+        halton_sequence new_seed_sequence();
+        // Children whose upper bound is more than pruning_margin_ below a sibling's lower
+        // bound leave the active set. Negative margin disables pruning.
+        double pruning_margin_;
+        bool free_pruned_;
+        long pruned_branches_;
+        // Returns true if any child was pruned.
+        bool prune_dominated_children(StateNodeExpansion& expansion, double threshold);
+        // Aiming at existing states when predict_inverse_fn is set. See set_aiming.
+        int aim_candidates_;
+        double aim_distance_ratio_;
+        double aim_score_ratio_;
+        long aimed_expansions_;
+        std::function<void(const std::vector<double>&)> best_action_fn_;
+        bool has_best_root_actuation_;
+        std::vector<double> best_root_actuation_;
+        void notify_if_best_action_changed();
+        // Actuation distribution for a node, mixing the policy with the prior plan.
+        Distribution proposal(const Distribution& policy, int level);
+        // Callback wrappers that add caching and tracing.
+        double value(vector_view state);
+        Distribution policy(vector_view state);
+        Distribution predict(vector_view state, vector_view actuation);
+        // One distribution per actuation, from predict_batch_fn in a single call for cache misses if it is set.
+        void predict(vector_view state, const std::vector<vector_view>& actuations,
+                     std::vector<Distribution>& distributions);
+        void predict_inverse(vector_view state1, vector_view state2, std::vector<double>& actuation);
+        // One actuation per target, from predict_inverse_batch_fn in a single call if it is set.
+        void predict_inverse(vector_view state1, const std::vector<vector_view>& targets,
+                             std::vector<std::vector<double>>& actuations);
         void ensure_consistent_state();
         // figure_once takes a small step toward solving the optimization problem.
         void figure_once();
+        // True when the best child of the root is known to be best within error bars.
+        bool root_action_separated(double margin) const;
         double default_sparsity_error_for_state_node();
         double default_sparsity_error_for_distribution_node();
         void refresh_state_node(int state_node_id);
         void refresh_distribution_node(int distribution_node_id);
+        // Call policy_fn and allocate expansion data if not already done. Only expanded
+        // nodes are indexed for reuse by nearby states.
+        StateNodeExpansion& expand_state_node(int state_node_id);
+        // Children of a state node, empty for a leaf.
+        const std::pmr::vector<StateDistributionEdge>& children(int state_node_id) const;
         StateDistributionEdge create_from_state_node(int state_node_id);
         StateDistributionEdge create_or_explore_from_state_node(int state_node_id);
         DistributionStateEdge create_from_distribution_node(int distribution_node_id);
         DistributionStateEdge create_or_explore_from_distribution_node(int distribution_node_id);
-        std::unordered_map<int,StateNode> node_id_to_state_node_;
-        int initial_state_node_id_;
-        int max_state_node_id_;
-        std::unordered_map<int,DistributionNode> node_id_to_distribution_node_;
-        int max_distribution_node_id_;
+        NodeStatistics state_stats_;
+        NodeStatistics distribution_stats_;
+        // Iterations between automatic calls to compact. Zero disables.
+        int compaction_interval_;
+        int iterations_since_compaction_;
         void showStateDistEdge(std::ostream& os, const StateDistributionEdge& edge, int indent) const;
         void showDistStateEdge(std::ostream& os, const DistributionStateEdge& edge, int indent) const;
+        // False for null function pointers and empty std::functions.
+        template<typename Fn> static bool has_target(const Fn& fn) {
+            if constexpr (std::is_constructible_v<bool, const Fn&>) {
+                return static_cast<bool>(fn);
+            } else {
+                return true;
+            }
+        }
+        // Callback with the internal vector_view signature, copying views into vectors
+        // for callbacks that take std::vector<double>.
+        template<typename Result, typename... Views, typename Fn>
+        static std::function<Result(Views...)> view_callback(Fn fn) {
+            if constexpr (std::is_same_v<Fn, std::nullptr_t>) {
+                return nullptr;
+            } else if constexpr (std::is_invocable_r_v<Result, Fn&, Views...>) {
+                return fn;
+            } else {
+                if(!has_target(fn)) {
+                    return nullptr;
+                }
+                return [fn](Views... views) { return fn(views.to_vector()...); };
+            }
+        }
+        // As view_callback, for callbacks whose vector result is written into a buffer.
+        template<typename... Views, typename Fn>
+        static std::function<void(Views...,std::vector<double>&)> output_callback(Fn fn) {
+            if constexpr (std::is_same_v<Fn, std::nullptr_t>) {
+                return nullptr;
+            } else if constexpr (std::is_invocable_v<Fn&, Views..., std::vector<double>&>) {
+                return fn;
+            } else {
+                if(!has_target(fn)) {
+                    return nullptr;
+                }
+                return [fn](Views... views, std::vector<double>& output) { output = fn(views.to_vector()...); };
+            }
+        }
     public:
         Context();
+        // Copies rebuild the tree in their own memory. Moves take the tree without copying it.
+        Context(const Context& other);
+        Context(Context&& other);
+        Context& operator=(const Context& other);
+        Context& operator=(Context&& other);
         ~Context();
         void set_state_size(int state_size);
         void set_actuation_size(int actuation_size);
         void set_depth(int depth);
         void set_initial_state(std::vector<double> initial_state);
-        void set_value_fn(std::function<double(std::vector<double>)> value_fn);
-        void set_policy_fn(std::function<Distribution(std::vector<double>)> policy_fn);
-        void set_predict_fn(std::function<Distribution(std::vector<double>,std::vector<double>)> predict_fn);
-        void set_predict_inverse_fn(std::function<std::vector<double>(std::vector<double>,std::vector<double>)> predict_inverse_fn);
+        // Callbacks may take states and actuations as std::vector<double> copies, or as
+        // vector_view to read them in place. Callbacks taking vector_view write vector
+        // outputs into a buffer owned by the caller, which may be reused between calls, so
+        // they should assign or resize rather than append. Passing nullptr clears a callback.
+        template<typename Fn> void set_value_fn(Fn value_fn) {
+            value_fn_ = view_callback<double, vector_view>(std::move(value_fn));
+        }
+        template<typename Fn> void set_policy_fn(Fn policy_fn) {
+            policy_fn_ = view_callback<Distribution, vector_view>(std::move(policy_fn));
+        }
+        template<typename Fn> void set_predict_fn(Fn predict_fn) {
+            predict_fn_ = view_callback<Distribution, vector_view, vector_view>(std::move(predict_fn));
+        }
+        template<typename Fn> void set_predict_inverse_fn(Fn predict_inverse_fn) {
+            predict_inverse_fn_ = output_callback<vector_view, vector_view>(std::move(predict_inverse_fn));
+        }
+        // Like predict_inverse_fn for several targets at once, writing one actuation per target.
+        // Used instead of predict_inverse_fn when set.
+        void set_predict_inverse_batch_fn(
+                std::function<void(vector_view,const std::vector<vector_view>&,std::vector<std::vector<double>>&)>
+                predict_inverse_batch_fn);
+        // Like predict_fn for several actuations from one state, writing one distribution per
+        // actuation. Aiming uses it instead of predict_fn when set.
+        void set_predict_batch_fn(
+                std::function<void(vector_view,const std::vector<vector_view>&,std::vector<Distribution>&)>
+                predict_batch_fn);
+        // Reuse policy_fn and predict_fn results for inputs that round to the same point
+        // on a grid with the given spacing. Keeps up to capacity results per callback,
+        // evicting the least recently used. Capacity of zero disables caching.
+        void set_callback_cache(int capacity, double grid_size);
+        // Stop growing the tree at this depth and estimate the remaining steps of lookahead
+        // with a rollout that allocates no nodes. Negative disables.
+        void set_rollout_depth(int rollout_depth);
+        template<typename Fn> void set_rollout_fn(Fn rollout_fn) {
+            rollout_fn_ = output_callback<vector_view>(std::move(rollout_fn));
+        }
+        // Find nearby states approximately by random projection. More candidates gives higher
+        // recall, reported in stats(). Projected dimension of zero restores exact search.
+        void set_approximate_state_index(int projected_dimension, int candidates);
+        // Warm start from the plan chosen on the previous cycle. The plan is shifted by one
+        // step, so its second actuation is the prior for the root. At each level, actuations
+        // are drawn with probability weight from a box of half-width spread around the prior
+        // actuation and otherwise from policy_fn. Weight of zero disables.
+        void set_prior_plan(const Plan& plan, double weight, double spread);
+        // Draw the children of each node from a scrambled Halton sequence instead of
+        // independent random seeds, so that successive children spread evenly over the
+        // actuation and outcome distributions. Off by default.
+        void set_quasi_random_sampling(bool enabled);
+        // Seed the generator behind every random choice the context makes. Each context
+        // starts with the same fixed seed.
+        void set_seed(uint32_t seed);
+        // Discard the whole tree and start planning from a new initial state. Callbacks,
+        // caches and configuration are kept, as is the capacity of node storage, so a
+        // receding horizon loop can plan each cycle without reallocating. Takes time
+        // linear in the tree size, since each node's expansion and distributions are
+        // destroyed one by one before the arena is released.
+        void reset(std::vector<double> initial_state);
+        // Stop visiting a child branch once its value plus error is more than margin below
+        // a sibling's value minus error. Pruned branches are kept on a cold list, or with
+        // free_pruned are dropped. Dropped nodes are only reclaimed by compaction, so
+        // freeing needs a compaction interval or calls to compact.
+        // Negative margin disables.
+        void set_pruning(double margin, bool free_pruned = false);
+        // Aim new actuations at the nearest candidates expanded states, preferring policy density times
+        // novelty. Targets must be within distance_ratio and above score_ratio of unaimed.
+        void set_aiming(int candidates, double distance_ratio = 0.04, double score_ratio = 0.2);
+        // Called during search whenever the root's best first actuation changes, including
+        // when it is first known. Runs inside figure calls, so it must not modify the context.
+        void set_best_action_fn(std::function<void(const std::vector<double>&)> best_action_fn);
+        // Compact the tree after every given number of iterations. Zero disables.
+        void set_compaction_interval(int iterations);
 
         void figure_seconds(double seconds);
         void figure_iterations(int iterations);
+        // Search until a confidence criterion or a work limit is reached.
+        FigureResult figure_until(const StopCriteria& criteria);
         Plan sample_plan();
         Plan sample_plan(int depth);
+        SearchStats stats() const;
+        // Statistics for every active child of the root.
+        std::vector<RootAction> root_actions() const;
+        // Best plan found so far without sampling or output, following the best child at each
+        // level and the most likely outcome of each actuation. Empty before the first search.
+        Plan principal_variation() const;
+        // Renumber and relocate reachable nodes so that each node's children are
+        // adjacent and follow their parent in depth-first order. Nodes that are no
+        // longer reachable from the initial state are discarded.
+        void compact();
 
         friend std::ostream& operator<<(std::ostream& os, const figurer::Context& context);
+        friend class BatchPlanner;
     };
 }
 
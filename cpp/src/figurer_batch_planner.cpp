@@ -0,0 +1,214 @@
+#include "figurer_batch_planner.hpp"
+#include <cmath>
+#include <stdexcept>
+
+namespace figurer {
+
+    BatchPlanner::BatchPlanner(int thread_count) : iterations_per_task_{10}, progress_fn_{nullptr},
+        generation_{0}, stopping_{false}, remaining_tasks_{0}, queued_tasks_{0}, iteration_limit_{-1} {
+        if(thread_count < 1) {
+            thread_count = 1;
+        }
+        for(int i = 0; i < thread_count; i++) {
+            queues_.emplace_back(new work_queue());
+        }
+        for(int i = 0; i < thread_count; i++) {
+            workers_.emplace_back(&BatchPlanner::worker_loop, this, i);
+        }
+    }
+
+    BatchPlanner::~BatchPlanner() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        start_condition_.notify_all();
+        for(auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    int BatchPlanner::add_context(Context& context) {
+        contexts_.push_back(&context);
+        progress_.push_back(BatchProgress{0, 0.0, 0.0, false});
+        return contexts_.size() - 1;
+    }
+
+    int BatchPlanner::context_count() const {
+        return contexts_.size();
+    }
+
+    void BatchPlanner::set_iterations_per_task(int iterations) {
+        if(iterations < 1) {
+            throw std::invalid_argument("Iterations per task must be positive");
+        }
+        iterations_per_task_ = iterations;
+    }
+
+    void BatchPlanner::set_progress_fn(std::function<void(int,const BatchProgress&)> progress_fn) {
+        progress_fn_ = move(progress_fn);
+    }
+
+    void BatchPlanner::figure_seconds(double seconds) {
+        deadline_ = std::chrono::high_resolution_clock::now()
+                + std::chrono::microseconds((long) (seconds * pow(10,6)));
+        iteration_limit_ = -1;
+        run_round();
+    }
+
+    void BatchPlanner::figure_iterations(int iterations) {
+        deadline_ = std::chrono::high_resolution_clock::time_point::max();
+        iteration_limit_ = iterations;
+        run_round();
+    }
+
+    BatchProgress BatchPlanner::progress(int context_index) const {
+        return progress_.at(context_index);
+    }
+
+    std::vector<Plan> BatchPlanner::sample_plans() {
+        std::vector<Plan> plans;
+        for(Context* context : contexts_) {
+            plans.push_back(context->sample_plan());
+        }
+        return plans;
+    }
+
+    void BatchPlanner::run_round() {
+        if(contexts_.empty()) {
+            return;
+        }
+        error_ = nullptr;
+        {
+            // Count tasks before queueing them, so a worker still finishing the previous
+            // round can't take one before it is counted.
+            std::lock_guard<std::mutex> lock(mutex_);
+            remaining_tasks_ = contexts_.size();
+            queued_tasks_ = contexts_.size();
+        }
+        for(size_t i = 0; i < contexts_.size(); i++) {
+            progress_[i].iterations = 0;
+            progress_[i].finished = false;
+            // Spread contexts evenly so stealing is only needed to balance uneven work.
+            work_queue& queue = *queues_[i % queues_.size()];
+            std::lock_guard<std::mutex> queue_lock(queue.mutex);
+            queue.tasks.push_back(i);
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        generation_++;
+        start_condition_.notify_all();
+        done_condition_.wait(lock, [this]() { return remaining_tasks_ == 0; });
+        if(error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    void BatchPlanner::worker_loop(int worker_index) {
+        long seen_generation = 0;
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_condition_.wait(lock, [this, seen_generation]() {
+                    return stopping_ || generation_ != seen_generation;
+                });
+                if(stopping_) {
+                    return;
+                }
+                seen_generation = generation_;
+            }
+            int task;
+            while(true) {
+                if(take_task(worker_index, task)) {
+                    run_task(worker_index, task);
+                    continue;
+                }
+                // Every remaining context is already being worked on by another thread.
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_condition_.wait(lock, [this]() { return queued_tasks_ > 0 || remaining_tasks_ == 0; });
+                if(remaining_tasks_ == 0) {
+                    break;
+                }
+            }
+        }
+    }
+
+    bool BatchPlanner::take_task(int worker_index, int& task) {
+        {
+            work_queue& own = *queues_[worker_index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                queued_tasks_--;
+                return true;
+            }
+        }
+        for(size_t offset = 1; offset < queues_.size(); offset++) {
+            work_queue& victim = *queues_[(worker_index + offset) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                queued_tasks_--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void BatchPlanner::run_task(int worker_index, int task) {
+        Context& context = *contexts_[task];
+        BatchProgress& progress = progress_[task];
+        bool finished = false;
+        try {
+            if(progress.iterations == 0) {
+                context.ensure_consistent_state();
+            }
+            for(int i = 0; i < iterations_per_task_; i++) {
+                if(iteration_limit_ >= 0 && progress.iterations >= iteration_limit_) {
+                    finished = true;
+                    break;
+                }
+                context.figure_once();
+                progress.iterations++;
+                if(std::chrono::high_resolution_clock::now() > deadline_) {
+                    finished = true;
+                    break;
+                }
+            }
+            if(iteration_limit_ >= 0 && progress.iterations >= iteration_limit_) {
+                finished = true;
+            }
+            progress.value = context.state_stats_.value[context.initial_state_node_id_];
+            progress.total_error = context.state_stats_.total_error[context.initial_state_node_id_];
+            progress.finished = finished;
+            if(progress_fn_) {
+                progress_fn_(task, progress);
+            }
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(!error_) {
+                error_ = std::current_exception();
+            }
+            finished = true;
+        }
+        if(!finished) {
+            {
+                work_queue& own = *queues_[worker_index];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                own.tasks.push_back(task);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queued_tasks_++;
+            }
+            work_condition_.notify_one();
+            return;
+        }
+        if(--remaining_tasks_ == 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_condition_.notify_all();
+            work_condition_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef FIGURER_BATCH_PLANNER_HPP
+#define FIGURER_BATCH_PLANNER_HPP
+
+#include "figurer.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace figurer {
+
+    struct BatchProgress {
+        // Iterations completed during the most recent figure call.
+        int iterations;
+        double value;
+        double total_error;
+        bool finished;
+    };
+
+    // Plans for many independent contexts on a shared pool of worker threads.
+    // Each context is worked on by at most one thread at a time, so a context
+    // needs no locking of its own. Callbacks shared between contexts must be
+    // safe to call from several threads. Each context still calls its own
+    // callbacks one at a time; calls from different contexts are not batched.
+    class BatchPlanner {
+        struct work_queue {
+            std::mutex mutex;
+            std::deque<int> tasks;
+        };
+        std::vector<Context*> contexts_;
+        std::vector<BatchProgress> progress_;
+        // Iterations per task before a context is handed back to the queue.
+        int iterations_per_task_;
+        std::function<void(int,const BatchProgress&)> progress_fn_;
+        // Each worker takes tasks from the front of its own queue and steals
+        // from the back of other queues when its own queue runs dry.
+        std::vector<std::unique_ptr<work_queue>> queues_;
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable start_condition_;
+        std::condition_variable done_condition_;
+        // Wakes idle workers when a task is handed back or the round ends.
+        std::condition_variable work_condition_;
+        long generation_;
+        bool stopping_;
+        std::atomic<int> remaining_tasks_;
+        // Tasks waiting in queues. Only incremented while holding mutex_.
+        std::atomic<int> queued_tasks_;
+        // Limits for the current round. Iteration limit of -1 means run until deadline.
+        std::chrono::high_resolution_clock::time_point deadline_;
+        int iteration_limit_;
+        std::exception_ptr error_;
+        void worker_loop(int worker_index);
+        bool take_task(int worker_index, int& task);
+        void run_task(int worker_index, int task);
+        void run_round();
+    public:
+        explicit BatchPlanner(int thread_count = std::thread::hardware_concurrency());
+        ~BatchPlanner();
+        BatchPlanner(const BatchPlanner&) = delete;
+        BatchPlanner& operator=(const BatchPlanner&) = delete;
+        // Contexts must outlive the planner. Returns index used for progress and plans.
+        int add_context(Context& context);
+        int context_count() const;
+        void set_iterations_per_task(int iterations);
+        // Called from worker threads after each task, so must be thread safe.
+        void set_progress_fn(std::function<void(int,const BatchProgress&)> progress_fn);
+
+        // Share one deadline across all contexts.
+        void figure_seconds(double seconds);
+        // Run the given number of iterations on every context.
+        void figure_iterations(int iterations);
+        BatchProgress progress(int context_index) const;
+        std::vector<Plan> sample_plans();
+    };
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include "figurer_callback_cache.hpp"
+#include <cmath>
+#include <stdexcept>
+
+namespace figurer {
+
+    size_t quantized_key_hash::operator()(const quantized_key& key) const {
+        size_t result = key.size();
+        for(int64_t cell : key) {
+            result ^= std::hash<int64_t>{}(cell) + 0x9e3779b97f4a7c15ULL + (result << 6) + (result >> 2);
+        }
+        return result;
+    }
+
+    quantized_key quantize(vector_view input, double grid_size) {
+        if(grid_size <= 0) {
+            throw std::invalid_argument("Cache grid size must be positive");
+        }
+        quantized_key key(input.size());
+        for(size_t i = 0; i < input.size(); i++) {
+            key[i] = std::llround(input[i] / grid_size);
+        }
+        return key;
+    }
+
+    quantized_key quantize(vector_view input1, vector_view input2, double grid_size) {
+        quantized_key key = quantize(input1, grid_size);
+        quantized_key key2 = quantize(input2, grid_size);
+        // Record the split point so (a,bc) and (ab,c) get different keys.
+        key.push_back(input1.size());
+        key.insert(key.end(), key2.begin(), key2.end());
+        return key;
+    }
+
+    quantized_key quantize(const std::vector<double>& input, double grid_size) {
+        return quantize(vector_view(input), grid_size);
+    }
+
+    quantized_key quantize(const std::vector<double>& input1, const std::vector<double>& input2, double grid_size) {
+        return quantize(vector_view(input1), vector_view(input2), grid_size);
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef FIGURER_CALLBACK_CACHE_HPP
+#define FIGURER_CALLBACK_CACHE_HPP
+
+#include "figurer_vector_view.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace figurer {
+
+    typedef std::vector<int64_t> quantized_key;
+
+    struct quantized_key_hash {
+        size_t operator()(const quantized_key& key) const;
+    };
+
+    // Round each coordinate to the nearest multiple of grid_size so that
+    // nearly identical inputs share a key.
+    quantized_key quantize(vector_view input, double grid_size);
+    quantized_key quantize(vector_view input1, vector_view input2, double grid_size);
+    quantized_key quantize(const std::vector<double>& input, double grid_size);
+    quantized_key quantize(const std::vector<double>& input1, const std::vector<double>& input2, double grid_size);
+
+    // Bounded memoisation of callback results with least-recently-used eviction.
+    // A capacity of zero disables the cache so every lookup computes directly.
+    template<typename Value>
+    class callback_cache {
+        typedef std::list<std::pair<quantized_key,Value>> entry_list;
+        size_t capacity_;
+        double grid_size_;
+        long hits_;
+        long misses_;
+        // Most recently used entries at the front.
+        entry_list entries_;
+        std::unordered_map<quantized_key,typename entry_list::iterator,quantized_key_hash> index_;
+    public:
+        callback_cache() : capacity_{0}, grid_size_{0}, hits_{0}, misses_{0} {}
+
+        void configure(int capacity, double grid_size) {
+            capacity_ = capacity > 0 ? capacity : 0;
+            grid_size_ = grid_size;
+            clear();
+        }
+
+        bool enabled() const { return capacity_ > 0; }
+
+        double grid_size() const { return grid_size_; }
+
+        // Copy the cached value for key into value. False on a miss.
+        bool find(const quantized_key& key, Value& value) {
+            auto found = index_.find(key);
+            if(found == index_.end()) {
+                misses_++;
+                return false;
+            }
+            hits_++;
+            entries_.splice(entries_.begin(), entries_, found->second);
+            value = found->second->second;
+            return true;
+        }
+
+        void insert(const quantized_key& key, Value value) {
+            auto found = index_.find(key);
+            if(found != index_.end()) {
+                found->second->second = std::move(value);
+                entries_.splice(entries_.begin(), entries_, found->second);
+                return;
+            }
+            entries_.emplace_front(key, std::move(value));
+            index_[key] = entries_.begin();
+            if(entries_.size() > capacity_) {
+                index_.erase(entries_.back().first);
+                entries_.pop_back();
+            }
+        }
+
+        template<typename Compute>
+        Value lookup(const quantized_key& key, Compute compute) {
+            Value value;
+            if(!find(key, value)) {
+                value = compute();
+                insert(key, value);
+            }
+            return value;
+        }
+
+        void clear() {
+            entries_.clear();
+            index_.clear();
+            hits_ = 0;
+            misses_ = 0;
+        }
+
+        long hits() const { return hits_; }
+        long misses() const { return misses_; }
+        int size() const { return entries_.size(); }
+    };
+}
+
+#endif
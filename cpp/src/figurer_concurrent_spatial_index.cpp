@@ -0,0 +1,212 @@
+#include "figurer_concurrent_spatial_index.hpp"
+#include "figurer_spatial_index.hpp"
+#include "figurer_trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace figurer {
+
+    concurrent_spatial_index::chunk::chunk(long capacity, int dimension) :
+        ids{new int[capacity]}, coordinates{new real_t[capacity * dimension]}, next{new long[capacity]} {}
+
+    concurrent_spatial_index::concurrent_spatial_index(int dimension, double cell_size, long bucket_count,
+                                                       long first_chunk_size) :
+        dimension_{dimension}, grid_dimension_{std::min(dimension, max_grid_dimension)}, cell_size_{cell_size},
+        first_chunk_size_{first_chunk_size}, bucket_count_{bucket_count}, reserved_{0}, published_{0} {
+        if(dimension < 1) {
+            throw std::invalid_argument("concurrent_spatial_index dimension must be positive");
+        }
+        if(!(cell_size > 0)) {
+            throw std::invalid_argument("concurrent_spatial_index cell size must be positive");
+        }
+        if(bucket_count < 1) {
+            throw std::invalid_argument("concurrent_spatial_index bucket count must be positive");
+        }
+        if(first_chunk_size < 1) {
+            throw std::invalid_argument("concurrent_spatial_index chunk size must be positive");
+        }
+        for(auto& c : chunks_) {
+            c.store(nullptr, std::memory_order_relaxed);
+        }
+        buckets_.reset(new std::atomic<long>[bucket_count]);
+        for(long b = 0; b < bucket_count; b++) {
+            buckets_[b].store(-1, std::memory_order_relaxed);
+        }
+    }
+
+    concurrent_spatial_index::~concurrent_spatial_index() {
+        for(auto& c : chunks_) {
+            delete c.load();
+        }
+    }
+
+    void concurrent_spatial_index::locate(long slot, int& chunk_index, long& offset) const {
+        // Chunk k holds first_chunk_size_ << k slots.
+        chunk_index = 0;
+        long chunk_size = first_chunk_size_;
+        while(slot >= chunk_size) {
+            slot -= chunk_size;
+            chunk_size *= 2;
+            chunk_index++;
+        }
+        offset = slot;
+    }
+
+    concurrent_spatial_index::chunk* concurrent_spatial_index::chunk_for(int chunk_index) {
+        chunk* existing = chunks_[chunk_index].load(std::memory_order_acquire);
+        if(existing) {
+            return existing;
+        }
+        // Several threads may race to allocate the same chunk. One wins and the rest discard theirs.
+        chunk* created = new chunk(first_chunk_size_ << chunk_index, dimension_);
+        if(chunks_[chunk_index].compare_exchange_strong(existing, created, std::memory_order_acq_rel)) {
+            return created;
+        }
+        delete created;
+        return existing;
+    }
+
+    const concurrent_spatial_index::chunk* concurrent_spatial_index::chunk_at(int chunk_index) const {
+        return chunks_[chunk_index].load(std::memory_order_acquire);
+    }
+
+    long concurrent_spatial_index::bucket(const std::vector<long>& cell) const {
+        uint64_t hash = 14695981039346656037ull;
+        for(long c : cell) {
+            hash = (hash ^ (uint64_t) c) * 1099511628211ull;
+        }
+        return (long) (hash % (uint64_t) bucket_count_);
+    }
+
+    void concurrent_spatial_index::add(int id, const std::vector<double>& position) {
+        if(position.size() != (size_t) dimension_) {
+            throw std::invalid_argument("Adding vector of dimension " + std::to_string(position.size()) +
+                                        " to concurrent_spatial_index of dimension " + std::to_string(dimension_));
+        }
+        long slot = reserved_.fetch_add(1, std::memory_order_relaxed);
+        int chunk_index;
+        long offset;
+        locate(slot, chunk_index, offset);
+        if(chunk_index >= max_chunks) {
+            throw std::length_error("concurrent_spatial_index is full");
+        }
+        chunk* c = chunk_for(chunk_index);
+        c->ids[offset] = id;
+        real_t* coordinates = &c->coordinates[offset * dimension_];
+        for(int j = 0; j < dimension_; j++) {
+            coordinates[j] = position[j];
+        }
+        std::vector<long> cell(grid_dimension_);
+        for(int j = 0; j < grid_dimension_; j++) {
+            cell[j] = (long) floor(position[j] / cell_size_);
+        }
+        // Publishing the slot as the new head also publishes the point written above.
+        std::atomic<long>& head = buckets_[bucket(cell)];
+        long previous = head.load(std::memory_order_relaxed);
+        do {
+            c->next[offset] = previous;
+        } while(!head.compare_exchange_weak(previous, slot, std::memory_order_release, std::memory_order_relaxed));
+        published_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void concurrent_spatial_index::search_bucket(long bucket, const stored_vector& query,
+                                                 long& closest_slot, real_t& closest_distance) const {
+        for(long slot = buckets_[bucket].load(std::memory_order_acquire); slot >= 0; ) {
+            int chunk_index;
+            long offset;
+            locate(slot, chunk_index, offset);
+            const chunk* c = chunk_at(chunk_index);
+            const real_t* coordinates = &c->coordinates[offset * dimension_];
+            real_t dist = 0;
+            for(int j = 0; j < dimension_; j++) {
+                real_t diff = query[j] - coordinates[j];
+                dist += diff * diff;
+            }
+            if(closest_slot < 0 || dist < closest_distance) {
+                closest_distance = dist;
+                closest_slot = slot;
+            }
+            slot = c->next[offset];
+        }
+    }
+
+    std::pair<int,std::vector<double>> concurrent_spatial_index::closest(const std::vector<double>& position) const {
+        FIGURER_TRACE_SCOPE("concurrent_spatial_index::closest");
+        if(position.size() != (size_t) dimension_) {
+            throw std::invalid_argument("Searching for vector of dimension " + std::to_string(position.size()) +
+                                        " in concurrent_spatial_index of dimension " + std::to_string(dimension_));
+        }
+        const stored_vector& query = to_stored(position);
+        std::vector<long> center(grid_dimension_);
+        for(int j = 0; j < grid_dimension_; j++) {
+            center[j] = (long) floor(position[j] / cell_size_);
+        }
+        long closest_slot = -1;
+        real_t closest_distance = 0;
+        std::vector<long> offsets(grid_dimension_);
+        std::vector<long> cell(grid_dimension_);
+        long cells_searched = 0;
+        for(long ring = 0; ; ring++) {
+            // Once a ring has more cells than there are buckets, scanning every bucket is cheaper.
+            long ring_cells = (long) pow(2 * ring + 1, grid_dimension_);
+            if(cells_searched + ring_cells > bucket_count_) {
+                closest_slot = -1;
+                for(long b = 0; b < bucket_count_; b++) {
+                    search_bucket(b, query, closest_slot, closest_distance);
+                }
+                break;
+            }
+            cells_searched += ring_cells;
+            // Visit each cell whose largest offset from the center is exactly ring.
+            std::fill(offsets.begin(), offsets.end(), -ring);
+            while(true) {
+                long largest = 0;
+                for(int j = 0; j < grid_dimension_; j++) {
+                    largest = std::max(largest, std::abs(offsets[j]));
+                    cell[j] = center[j] + offsets[j];
+                }
+                if(largest == ring) {
+                    search_bucket(bucket(cell), query, closest_slot, closest_distance);
+                }
+                int j = 0;
+                while(j < grid_dimension_ && offsets[j] == ring) {
+                    offsets[j] = -ring;
+                    j++;
+                }
+                if(j == grid_dimension_) {
+                    break;
+                }
+                offsets[j]++;
+            }
+            // Points in later rings are more than ring cell widths away along some grid coordinate.
+            if(closest_slot >= 0 && closest_distance <= pow(ring * cell_size_, 2)) {
+                break;
+            }
+        }
+        if(closest_slot < 0) {
+            throw std::invalid_argument("Can't find closest point in empty data set");
+        }
+        int chunk_index;
+        long offset;
+        locate(closest_slot, chunk_index, offset);
+        const chunk* c = chunk_at(chunk_index);
+        const real_t* begin = &c->coordinates[offset * dimension_];
+        return {c->ids[offset], std::vector<double>(begin, begin + dimension_)};
+    }
+
+    double concurrent_spatial_index::closest_distance(const std::vector<double>& position) const {
+        return sqrt(closest_distance2(position));
+    }
+
+    double concurrent_spatial_index::closest_distance2(const std::vector<double>& position) const {
+        auto found = closest(position);
+        return distance2(position, found.second);
+    }
+
+    int concurrent_spatial_index::size() const {
+        return published_.load(std::memory_order_relaxed);
+    }
+}
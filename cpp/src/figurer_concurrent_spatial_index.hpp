@@ -0,0 +1,64 @@
+#ifndef FIGURER_FIGURER_CONCURRENT_SPATIAL_INDEX_HPP
+#define FIGURER_FIGURER_CONCURRENT_SPATIAL_INDEX_HPP
+
+#include "figurer_precision.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace figurer {
+
+    // Spatial index that many threads can add to and search at the same time.
+    //
+    // Points are hashed into buckets by their cell in a uniform grid over the first
+    // few coordinates. Each bucket is an append-only linked list of slots whose head
+    // is swapped in with compare-and-swap, so inserts never take a lock. Slots live in
+    // chunks that double in size and never move once written. A lookup searches rings
+    // of cells outward from the query and stops once no unsearched cell can hold a
+    // closer point. It only follows links that existed when it read each bucket head,
+    // so it finishes in a bounded number of steps regardless of concurrent inserts.
+    class concurrent_spatial_index {
+        struct chunk {
+            std::unique_ptr<int[]> ids;
+            std::unique_ptr<real_t[]> coordinates;
+            // Slot added to the same bucket before this one, or -1.
+            std::unique_ptr<long[]> next;
+            chunk(long capacity, int dimension);
+        };
+        static constexpr int max_chunks = 40;
+        static constexpr int max_grid_dimension = 3;
+        int dimension_;
+        int grid_dimension_;
+        double cell_size_;
+        long first_chunk_size_;
+        std::atomic<chunk*> chunks_[max_chunks];
+        long bucket_count_;
+        // Most recently added slot in each bucket, or -1.
+        std::unique_ptr<std::atomic<long>[]> buckets_;
+        std::atomic<long> reserved_;
+        std::atomic<long> published_;
+        void locate(long slot, int& chunk_index, long& offset) const;
+        chunk* chunk_for(int chunk_index);
+        const chunk* chunk_at(int chunk_index) const;
+        long bucket(const std::vector<long>& cell) const;
+        // Update closest_slot and closest_distance with every point in the bucket.
+        void search_bucket(long bucket, const stored_vector& query, long& closest_slot, real_t& closest_distance) const;
+    public:
+        // Cells should be around the typical distance between neighbouring points.
+        concurrent_spatial_index(int dimension, double cell_size, long bucket_count = 1 << 16,
+                                 long first_chunk_size = 1024);
+        ~concurrent_spatial_index();
+        concurrent_spatial_index(const concurrent_spatial_index&) = delete;
+        concurrent_spatial_index& operator=(const concurrent_spatial_index&) = delete;
+        // Lock-free. Safe to call concurrently with other adds and lookups.
+        void add(int id, const std::vector<double>& position);
+        // Wait-free. Points still being added by other threads may be missed.
+        std::pair<int,std::vector<double>> closest(const std::vector<double>& position) const;
+        double closest_distance(const std::vector<double>& position) const;
+        double closest_distance2(const std::vector<double>& position) const;
+        // Number of points fully added.
+        int size() const;
+    };
+}
+
+#endif
@@ -1,10 +1,58 @@
 #include "figurer_distribution.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
 
 namespace figurer {
 
+    namespace {
+        // Index i such that u falls in the i-th interval of the cumulative weights.
+        int choose_index(const std::vector<double>& weights, double u) {
+            double cumulative = 0;
+            for(size_t i = 0; i < weights.size(); i++) {
+                cumulative += weights[i];
+                if(u < cumulative) {
+                    return i;
+                }
+            }
+            return weights.size() - 1;
+        }
+
+        // Action id encoded in the first coordinate, or -1 if it isn't a valid id.
+        int action_id(const std::vector<double>& val, int action_count) {
+            if(val.empty()) {
+                return -1;
+            }
+            int id = (int) std::lround(val[0]);
+            if(id < 0 || id >= action_count || val[0] != id) {
+                return -1;
+            }
+            return id;
+        }
+
+        std::vector<double> normalized_probabilities(std::vector<double> probabilities) {
+            double total = 0;
+            for(double probability : probabilities) {
+                if(probability < 0) {
+                    throw std::invalid_argument("Action probabilities must not be negative");
+                }
+                total += probability;
+            }
+            if(total <= 0) {
+                throw std::invalid_argument("Action probabilities must not all be zero");
+            }
+            for(double& probability : probabilities) {
+                probability /= total;
+            }
+            return probabilities;
+        }
+    }
+
     Distribution::Distribution() {
         dimension_ = -1;
         seed_dimension_ = -1;
+        hybrid_ = false;
     }
 
     void Distribution::set_dimension(int dimension) {
@@ -35,27 +83,67 @@ namespace figurer {
         return sample_fn_(seed);
     }
 
+    std::vector<double> Distribution::sample(const std::vector<double>& seed) {
+        return sample_fn_(seed);
+    }
+
+    int Distribution::seed_dimension() const {
+        return seed_dimension_ >= 0 ? seed_dimension_ : dimension_;
+    }
+
+    std::vector<double> Distribution::central_sample() {
+        int size = seed_dimension_ >= 0 ? seed_dimension_ : dimension_;
+        if (size < 0) {
+            throw std::invalid_argument("Need to set seed_dimension before sampling");
+        }
+        return sample_fn_(std::vector<double>(size, 0.5));
+    }
+
     double Distribution::density(std::vector<double> coordinates) {
         return density_fn_(coordinates);
     }
 
+    void Distribution::set_actions(std::vector<double> probabilities, bool hybrid) {
+        action_probabilities_ = move(probabilities);
+        hybrid_ = hybrid;
+    }
+
+    int Distribution::action_count() const {
+        return action_probabilities_.size();
+    }
+
+    double Distribution::action_probability(int action) const {
+        if(action < 0 || (size_t) action >= action_probabilities_.size()) {
+            return 0;
+        }
+        return action_probabilities_[action];
+    }
+
+    bool Distribution::hybrid() const {
+        return hybrid_;
+    }
+
     Distribution uniform_distribution(std::vector<double> bounds) {
         size_t size = bounds.size();
         size_t dimension = size / 2;
         if(size != dimension * 2) {
             throw std::invalid_argument("Bounds must have even size");
         }
+        // Shared so that sampling and density don't each hold a copy of the bounds.
+        auto shared_bounds = std::make_shared<const std::vector<double>>(move(bounds));
         Distribution distribution;
         distribution.set_dimension(dimension);
-        distribution.set_sample_fn([dimension, bounds](std::vector<double> seed) {
+        distribution.set_sample_fn([dimension, shared_bounds](std::vector<double> seed) {
+            const std::vector<double>& bounds = *shared_bounds;
             std::vector<double> result(dimension,0.0);
-            for(int i = 0; i < dimension; i++) {
+            for(size_t i = 0; i < dimension; i++) {
                 result[i] = bounds[i*2] + seed[i] * (bounds[i*2+1] - bounds[i*2]);
             }
             return result;
         });
-        distribution.set_density_fn([dimension, bounds](std::vector<double> val) {
-            for(int i = 0; i < dimension; i++) {
+        distribution.set_density_fn([dimension, shared_bounds](std::vector<double> val) {
+            const std::vector<double>& bounds = *shared_bounds;
+            for(size_t i = 0; i < dimension; i++) {
                 if((val[i] < bounds[i*2]) || (val[i] > bounds[i*2+1])) {
                     return 0.0;
                 }
@@ -64,4 +152,96 @@ namespace figurer {
         });
         return distribution;
     }
+
+    Distribution mixture_distribution(std::vector<Distribution> components, std::vector<double> weights) {
+        if(components.empty() || components.size() != weights.size()) {
+            throw std::invalid_argument("Mixture needs one weight per component and at least one component");
+        }
+        double total_weight = 0;
+        int component_seed_dimension = 0;
+        for(size_t i = 0; i < components.size(); i++) {
+            if(weights[i] < 0) {
+                throw std::invalid_argument("Mixture weights must not be negative");
+            }
+            total_weight += weights[i];
+            component_seed_dimension = std::max(component_seed_dimension, components[i].seed_dimension());
+        }
+        if(total_weight <= 0) {
+            throw std::invalid_argument("Mixture weights must not all be zero");
+        }
+        for(double& weight : weights) {
+            weight /= total_weight;
+        }
+        // Shared so that copies of the distribution don't copy every component.
+        auto shared_components = std::make_shared<std::vector<Distribution>>(move(components));
+        Distribution distribution;
+        // First seed value selects the component and the rest seed the component.
+        distribution.set_seed_dimension(component_seed_dimension + 1);
+        distribution.set_sample_fn([shared_components, weights](std::vector<double> seed) {
+            Distribution& component = (*shared_components)[choose_index(weights, seed[0])];
+            std::vector<double> component_seed(seed.begin() + 1, seed.begin() + 1 + component.seed_dimension());
+            return component.sample(component_seed);
+        });
+        distribution.set_density_fn([shared_components, weights](std::vector<double> val) {
+            double result = 0;
+            for(size_t i = 0; i < weights.size(); i++) {
+                if(weights[i] > 0) {
+                    result += weights[i] * (*shared_components)[i].density(val);
+                }
+            }
+            return result;
+        });
+        return distribution;
+    }
+
+    Distribution categorical_distribution(std::vector<double> probabilities) {
+        if(probabilities.empty()) {
+            throw std::invalid_argument("Categorical distribution needs at least one action");
+        }
+        probabilities = normalized_probabilities(move(probabilities));
+        Distribution distribution;
+        distribution.set_dimension(1);
+        distribution.set_actions(probabilities, false);
+        distribution.set_sample_fn([probabilities](std::vector<double> seed) {
+            return std::vector<double>{(double) choose_index(probabilities, seed[0])};
+        });
+        distribution.set_density_fn([probabilities](std::vector<double> val) {
+            int id = action_id(val, probabilities.size());
+            return id < 0 || val.size() != 1 ? 0.0 : probabilities[id];
+        });
+        return distribution;
+    }
+
+    Distribution hybrid_distribution(std::vector<double> probabilities, std::vector<Distribution> continuous) {
+        if(probabilities.empty() || probabilities.size() != continuous.size()) {
+            throw std::invalid_argument("Hybrid distribution needs one continuous distribution per action");
+        }
+        probabilities = normalized_probabilities(move(probabilities));
+        int component_seed_dimension = 0;
+        for(auto& component : continuous) {
+            component_seed_dimension = std::max(component_seed_dimension, component.seed_dimension());
+        }
+        auto shared_components = std::make_shared<std::vector<Distribution>>(move(continuous));
+        Distribution distribution;
+        // First seed value selects the action and the rest seed its continuous part.
+        distribution.set_seed_dimension(component_seed_dimension + 1);
+        distribution.set_actions(probabilities, true);
+        distribution.set_sample_fn([shared_components, probabilities](std::vector<double> seed) {
+            int chosen = choose_index(probabilities, seed[0]);
+            Distribution& component = (*shared_components)[chosen];
+            std::vector<double> component_seed(seed.begin() + 1, seed.begin() + 1 + component.seed_dimension());
+            std::vector<double> result{(double) chosen};
+            std::vector<double> continuous_part = component.sample(component_seed);
+            result.insert(result.end(), continuous_part.begin(), continuous_part.end());
+            return result;
+        });
+        distribution.set_density_fn([shared_components, probabilities](std::vector<double> val) {
+            int id = action_id(val, probabilities.size());
+            if(id < 0 || probabilities[id] <= 0) {
+                return 0.0;
+            }
+            return probabilities[id] * (*shared_components)[id].density(std::vector<double>(val.begin() + 1, val.end()));
+        });
+        return distribution;
+    }
 }
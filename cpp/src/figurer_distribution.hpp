@@ -11,6 +11,8 @@ namespace figurer {
         int seed_dimension_;
         std::function<std::vector<double>(std::vector<double>)> sample_fn_;
         std::function<double(std::vector<double>)> density_fn_;
+        std::vector<double> action_probabilities_;
+        bool hybrid_;
     public:
         Distribution();
         void set_dimension(int dimension);
@@ -18,10 +20,32 @@ namespace figurer {
         void set_sample_fn(std::function<std::vector<double>(std::vector<double>)> sample_fn);
         void set_density_fn(std::function<double(std::vector<double>)> density_fn);
         std::vector<double> sample();
+        // Deterministic sample from a seed of seed_dimension values in [0,1].
+        std::vector<double> sample(const std::vector<double>& seed);
+        // Number of seed values needed per sample.
+        int seed_dimension() const;
+        // Sample with every seed coordinate at 0.5, a cheap stand-in for the mean.
+        std::vector<double> central_sample();
         double density(std::vector<double>);
+        // Mark samples as discrete actions: the first coordinate is an action id in
+        // [0, probabilities.size()) chosen with the given probabilities. Hybrid samples
+        // follow the action id with continuous coordinates.
+        void set_actions(std::vector<double> probabilities, bool hybrid);
+        // Number of discrete actions, or 0 for a continuous distribution.
+        int action_count() const;
+        double action_probability(int action) const;
+        bool hybrid() const;
     };
 
     Distribution uniform_distribution(std::vector<double> bounds);
+    // Samples component i with probability proportional to weights[i]. Components
+    // must have the same dimension. Density is the weighted sum of component densities.
+    Distribution mixture_distribution(std::vector<Distribution> components, std::vector<double> weights);
+    // Samples {i} with probability proportional to probabilities[i].
+    Distribution categorical_distribution(std::vector<double> probabilities);
+    // Samples {i, x...} where i is chosen as in categorical_distribution and x is
+    // sampled from continuous[i]. Continuous components must have the same dimension.
+    Distribution hybrid_distribution(std::vector<double> probabilities, std::vector<Distribution> continuous);
 }
 
 #endif
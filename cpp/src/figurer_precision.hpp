@@ -0,0 +1,80 @@
+#ifndef FIGURER_PRECISION_HPP
+#define FIGURER_PRECISION_HPP
+
+#include "figurer_vector_view.hpp"
+#include <memory_resource>
+#include <vector>
+
+namespace figurer {
+
+    // Storage type for state and actuation coordinates and for per-node statistics.
+    // Build with FIGURER_SINGLE_PRECISION to store these as float, which halves them but
+    // shrinks the whole tree by only about 12%, since distributions and fixed-size node
+    // bookkeeping don't shrink. Callbacks, plans, sums and running averages still use double.
+#ifdef FIGURER_SINGLE_PRECISION
+    typedef float real_t;
+#else
+    typedef double real_t;
+#endif
+
+    typedef std::vector<real_t> stored_vector;
+    // Coordinates held by tree nodes, allocated from the context's tree memory.
+    typedef std::pmr::vector<real_t> node_vector;
+
+    inline node_vector to_node_vector(const std::vector<double>& values, std::pmr::memory_resource* memory) {
+        return node_vector(values.begin(), values.end(), memory);
+    }
+
+    inline std::vector<double> to_double(const node_vector& values) {
+        return std::vector<double>(values.begin(), values.end());
+    }
+
+    // Whether stored coordinates match values once rounded to storage precision.
+    inline bool same_coordinates(const node_vector& stored, const std::vector<double>& values) {
+        if(stored.size() != values.size()) {
+            return false;
+        }
+        for(size_t i = 0; i < stored.size(); i++) {
+            if(stored[i] != (real_t) values[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Node coordinates passed to callbacks as doubles. Double precision builds view the
+    // node's own storage, while single precision builds have to convert into a copy.
+    class callback_coordinates {
+#ifdef FIGURER_SINGLE_PRECISION
+        std::vector<double> values_;
+    public:
+        explicit callback_coordinates(const node_vector& values) : values_(values.begin(), values.end()) {}
+        operator vector_view() const { return vector_view(values_); }
+#else
+        vector_view values_;
+    public:
+        explicit callback_coordinates(const node_vector& values) : values_{values.data(), values.size()} {}
+        operator vector_view() const { return values_; }
+#endif
+    };
+
+#ifdef FIGURER_SINGLE_PRECISION
+    inline stored_vector to_stored(const std::vector<double>& values) {
+        return stored_vector(values.begin(), values.end());
+    }
+
+    inline std::vector<double> to_double(const stored_vector& values) {
+        return std::vector<double>(values.begin(), values.end());
+    }
+#else
+    inline const stored_vector& to_stored(const std::vector<double>& values) {
+        return values;
+    }
+
+    inline const std::vector<double>& to_double(const stored_vector& values) {
+        return values;
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include "figurer_quasi_random.hpp"
+#include <stdexcept>
+
+namespace figurer {
+
+    namespace {
+        const int max_dimension = 1024;
+
+        // Prime base for each coordinate.
+        const std::vector<int>& primes() {
+            static const std::vector<int> table = []() {
+                std::vector<int> result;
+                for(int candidate = 2; result.size() < max_dimension; candidate++) {
+                    bool is_prime = true;
+                    for(int p : result) {
+                        if(p * p > candidate) {
+                            break;
+                        }
+                        if(candidate % p == 0) {
+                            is_prime = false;
+                            break;
+                        }
+                    }
+                    if(is_prime) {
+                        result.push_back(candidate);
+                    }
+                }
+                return result;
+            }();
+            return table;
+        }
+
+        // Shift for one coordinate of one sequence, in [0,1).
+        double rotation(uint32_t scramble, int coordinate) {
+            // splitmix64 finaliser for a well mixed shift per coordinate.
+            uint64_t z = ((uint64_t) scramble << 32) + coordinate + 0x9e3779b97f4a7c15ULL;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            z = z ^ (z >> 31);
+            return (z >> 11) * (1.0 / 9007199254740992.0);
+        }
+    }
+
+    double radical_inverse(uint32_t index, int base) {
+        double result = 0;
+        double scale = 1.0 / base;
+        while(index > 0) {
+            result += (index % base) * scale;
+            index /= base;
+            scale /= base;
+        }
+        return result;
+    }
+
+    halton_sequence::halton_sequence() : halton_sequence(0) {}
+
+    halton_sequence::halton_sequence(uint32_t scramble) : scramble_{scramble}, index_{0} {}
+
+    std::vector<double> halton_sequence::next(int dimension) {
+        if(dimension > max_dimension) {
+            throw std::invalid_argument("halton_sequence supports at most 1024 coordinates");
+        }
+        const std::vector<int>& bases = primes();
+        std::vector<double> point(dimension);
+        for(int i = 0; i < dimension; i++) {
+            double x = radical_inverse(index_, bases[i]) + rotation(scramble_, i);
+            point[i] = x >= 1.0 ? x - 1.0 : x;
+        }
+        index_++;
+        return point;
+    }
+
+    uint32_t halton_sequence::count() const {
+        return index_;
+    }
+}
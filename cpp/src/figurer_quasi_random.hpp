@@ -0,0 +1,33 @@
+#ifndef FIGURER_QUASI_RANDOM_HPP
+#define FIGURER_QUASI_RANDOM_HPP
+
+#include <cstdint>
+#include <vector>
+
+namespace figurer {
+
+    // Scrambled Halton sequence of seeds for Distribution::sample(seed).
+    //
+    // Successive points cover the unit cube evenly rather than clumping like
+    // independent draws: any n consecutive points in a single coordinate with
+    // base b fall one per interval of width 1/n whenever n is a power of b.
+    // Each sequence applies its own random shift modulo 1 (Cranley-Patterson
+    // rotation) so that sibling sequences are not identical. Only the scramble
+    // key and a counter are stored, so a sequence per node is cheap.
+    class halton_sequence {
+        uint32_t scramble_;
+        uint32_t index_;
+    public:
+        halton_sequence();
+        explicit halton_sequence(uint32_t scramble);
+        // Next point with the given number of coordinates, each in [0,1).
+        std::vector<double> next(int dimension);
+        // Number of points returned so far.
+        uint32_t count() const;
+    };
+
+    // Van der Corput radical inverse of index in the given base, in [0,1).
+    double radical_inverse(uint32_t index, int base);
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "figurer_robot2d_example.hpp"
+#include <cmath>
 
 /*
  * Robot2D: Simple example of how to use figurer
@@ -0,0 +1,345 @@
+#include "figurer_root_parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+namespace figurer {
+
+    namespace {
+        const uint64_t segment_magic = 0x6669677572657231ULL;
+        const int max_read_attempts = 1000;
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                      "Sequence lock needs address-free atomics to work across processes");
+
+        struct segment_header {
+            uint64_t magic;
+            int32_t worker_count;
+            int32_t state_size;
+            int32_t actuation_size;
+            int32_t max_actions;
+            int32_t max_plan_steps;
+            int32_t padding;
+            uint64_t slot_bytes;
+        };
+
+        // Followed by payload_bytes of doubles: per action the actuation, value, error
+        // and visits, then plan states, then plan actuations.
+        struct slot_header {
+            std::atomic<uint64_t> sequence;
+            int64_t publications;
+            int32_t action_count;
+            int32_t plan_steps;
+        };
+
+        size_t round_up(size_t bytes) {
+            // Keep slots on separate cache lines.
+            return (bytes + 63) / 64 * 64;
+        }
+    }
+
+    struct shared_root_segment {
+        std::string name;
+        void* base;
+        size_t size;
+        bool owner;
+
+        shared_root_segment(std::string segment_name, bool create, const segment_header& layout) :
+                name{std::move(segment_name)}, base{nullptr}, size{0}, owner{create} {
+            int fd;
+            if(create) {
+                // Exclusive so that a second coordinator can't take over a live segment.
+                fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+                if(fd < 0 && errno == EEXIST) {
+                    throw std::invalid_argument("Shared memory segment " + name + " already exists");
+                }
+                size = round_up(sizeof(segment_header)) + layout.worker_count * layout.slot_bytes;
+                if(fd >= 0 && ftruncate(fd, size) != 0) {
+                    close(fd);
+                    shm_unlink(name.c_str());
+                    fd = -1;
+                }
+            } else {
+                fd = shm_open(name.c_str(), O_RDWR, 0600);
+                segment_header existing{};
+                if(fd >= 0 && pread(fd, &existing, sizeof(existing), 0) == sizeof(existing)
+                        && existing.magic == segment_magic) {
+                    size = round_up(sizeof(segment_header)) + existing.worker_count * existing.slot_bytes;
+                } else if(fd >= 0) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+            if(fd < 0) {
+                throw std::invalid_argument("Can't open shared memory segment " + name);
+            }
+            base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if(base == MAP_FAILED) {
+                if(create) {
+                    shm_unlink(name.c_str());
+                }
+                throw std::invalid_argument("Can't map shared memory segment " + name);
+            }
+            if(create) {
+                // New shared memory is zero filled, so every sequence starts at zero.
+                *header() = layout;
+            }
+        }
+
+        ~shared_root_segment() {
+            munmap(base, size);
+            if(owner) {
+                shm_unlink(name.c_str());
+            }
+        }
+
+        segment_header* header() const {
+            return (segment_header*) base;
+        }
+
+        slot_header* slot(int worker_index) const {
+            if(worker_index < 0 || worker_index >= header()->worker_count) {
+                throw std::invalid_argument("Worker index " + std::to_string(worker_index) + " out of range");
+            }
+            char* slots = (char*) base + round_up(sizeof(segment_header));
+            return (slot_header*) (slots + worker_index * header()->slot_bytes);
+        }
+
+        double* payload(slot_header* s) const {
+            return (double*) ((char*) s + round_up(sizeof(slot_header)));
+        }
+
+        size_t action_doubles() const {
+            return header()->actuation_size + 3;
+        }
+
+        size_t payload_doubles() const {
+            const segment_header& h = *header();
+            return h.max_actions * action_doubles()
+                   + (h.max_plan_steps + 1) * h.state_size + h.max_plan_steps * h.actuation_size;
+        }
+    };
+
+    RootParallelCoordinator::RootParallelCoordinator(const std::string& name, int worker_count, int state_size,
+                                                     int actuation_size, int max_actions, int max_plan_steps) {
+        if(worker_count < 1 || state_size < 1 || actuation_size < 1 || max_actions < 1 || max_plan_steps < 0) {
+            throw std::invalid_argument("Invalid shared root segment layout");
+        }
+        segment_header layout{};
+        layout.magic = segment_magic;
+        layout.worker_count = worker_count;
+        layout.state_size = state_size;
+        layout.actuation_size = actuation_size;
+        layout.max_actions = max_actions;
+        layout.max_plan_steps = max_plan_steps;
+        size_t payload_doubles = max_actions * (actuation_size + 3)
+                                 + (max_plan_steps + 1) * state_size + max_plan_steps * actuation_size;
+        layout.slot_bytes = round_up(round_up(sizeof(slot_header)) + payload_doubles * sizeof(double));
+        segment_.reset(new shared_root_segment(name, true, layout));
+    }
+
+    RootParallelCoordinator::~RootParallelCoordinator() = default;
+
+    int RootParallelCoordinator::worker_count() const {
+        return segment_->header()->worker_count;
+    }
+
+    bool RootParallelCoordinator::snapshot(int worker_index, WorkerSnapshot& snapshot) const {
+        const segment_header& h = *segment_->header();
+        slot_header* s = segment_->slot(worker_index);
+        std::vector<double> copy(segment_->payload_doubles());
+        for(int attempt = 0; attempt < max_read_attempts; attempt++) {
+            uint64_t before = s->sequence.load(std::memory_order_acquire);
+            if(before == 0) {
+                return false;
+            }
+            if(before % 2 == 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            int64_t publications = s->publications;
+            int action_count = s->action_count;
+            int plan_steps = s->plan_steps;
+            memcpy(copy.data(), segment_->payload(s), copy.size() * sizeof(double));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(s->sequence.load(std::memory_order_relaxed) != before) {
+                continue;
+            }
+            // The copy is consistent, but check counts in case the writer is misbehaving.
+            if(action_count < 0 || action_count > h.max_actions || plan_steps < 0 || plan_steps > h.max_plan_steps) {
+                return false;
+            }
+            snapshot.publications = publications;
+            snapshot.root_actions.clear();
+            const double* in = copy.data();
+            for(int a = 0; a < action_count; a++) {
+                const double* action = in + a * segment_->action_doubles();
+                snapshot.root_actions.push_back(RootAction{
+                        std::vector<double>(action, action + h.actuation_size),
+                        action[h.actuation_size], action[h.actuation_size + 1], (int) action[h.actuation_size + 2]});
+            }
+            in += h.max_actions * segment_->action_doubles();
+            snapshot.plan.states.clear();
+            snapshot.plan.actuations.clear();
+            for(int step = 0; step <= plan_steps; step++) {
+                snapshot.plan.states.emplace_back(in + step * h.state_size, in + (step + 1) * h.state_size);
+            }
+            in += (h.max_plan_steps + 1) * h.state_size;
+            for(int step = 0; step < plan_steps; step++) {
+                snapshot.plan.actuations.emplace_back(in + step * h.actuation_size, in + (step + 1) * h.actuation_size);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<RootAction> RootParallelCoordinator::merged_root_actions(double merge_radius) const {
+        std::vector<RootAction> actions;
+        WorkerSnapshot snapshot;
+        for(int w = 0; w < worker_count(); w++) {
+            if(this->snapshot(w, snapshot)) {
+                actions.insert(actions.end(), snapshot.root_actions.begin(), snapshot.root_actions.end());
+            }
+        }
+        // Most visited actions become cluster centers first.
+        std::stable_sort(actions.begin(), actions.end(), [](const RootAction& a, const RootAction& b) {
+            return a.visits > b.visits;
+        });
+        std::vector<RootAction> merged;
+        std::vector<double> weights;
+        for(auto& action : actions) {
+            double weight = std::max(1, action.visits);
+            int cluster = -1;
+            for(size_t c = 0; c < merged.size(); c++) {
+                if(distance(merged[c].actuation, action.actuation) <= merge_radius) {
+                    cluster = c;
+                    break;
+                }
+            }
+            if(cluster < 0) {
+                merged.push_back(action);
+                weights.push_back(weight);
+                continue;
+            }
+            RootAction& center = merged[cluster];
+            double total_weight = weights[cluster] + weight;
+            center.value = (center.value * weights[cluster] + action.value * weight) / total_weight;
+            center.total_error = (center.total_error * weights[cluster] + action.total_error * weight) / total_weight;
+            center.visits += action.visits;
+            weights[cluster] = total_weight;
+        }
+        return merged;
+    }
+
+    Plan RootParallelCoordinator::merged_plan(double merge_radius) const {
+        std::vector<RootAction> merged = merged_root_actions(merge_radius);
+        if(merged.empty()) {
+            return Plan();
+        }
+        // Visits rather than value, so that a lucky action seen once can't outrank one
+        // that the workers kept returning to.
+        auto best = std::max_element(merged.begin(), merged.end(), [](const RootAction& a, const RootAction& b) {
+            return a.visits < b.visits;
+        });
+        Plan result;
+        double closest_distance = 0;
+        WorkerSnapshot snapshot;
+        for(int w = 0; w < worker_count(); w++) {
+            if(!this->snapshot(w, snapshot) || snapshot.plan.actuations.empty()) {
+                continue;
+            }
+            double d = distance(snapshot.plan.actuations[0], best->actuation);
+            if(result.actuations.empty() || d < closest_distance) {
+                closest_distance = d;
+                result = snapshot.plan;
+            }
+        }
+        return result;
+    }
+
+    RootParallelWorker::RootParallelWorker(const std::string& name, int worker_index) :
+            segment_{new shared_root_segment(name, false, segment_header{})}, worker_index_{worker_index} {
+        segment_->slot(worker_index);
+    }
+
+    RootParallelWorker::~RootParallelWorker() = default;
+
+    void RootParallelWorker::publish(const Context& context) {
+        const segment_header& h = *segment_->header();
+        std::vector<RootAction> actions = context.root_actions();
+        // Share the most visited actions if there are more than fit, since those are the
+        // ones merged_plan chooses between.
+        std::sort(actions.begin(), actions.end(), [](const RootAction& a, const RootAction& b) {
+            return a.visits > b.visits;
+        });
+        if(actions.size() > (size_t) h.max_actions) {
+            actions.resize(h.max_actions);
+        }
+        Plan plan = context.principal_variation();
+        int plan_steps = std::min<int>(plan.actuations.size(), h.max_plan_steps);
+        for(auto& action : actions) {
+            if(action.actuation.size() != (size_t) h.actuation_size) {
+                throw std::invalid_argument("Actuation size doesn't match shared root segment");
+            }
+        }
+        if(!plan.states.empty() && plan.states[0].size() != (size_t) h.state_size) {
+            throw std::invalid_argument("State size doesn't match shared root segment");
+        }
+        if(plan.states.empty()) {
+            return;
+        }
+        // Build the payload first so that the slot is odd for as short a time as possible.
+        std::vector<double> payload(segment_->payload_doubles(), 0.0);
+        double* out = payload.data();
+        for(size_t a = 0; a < actions.size(); a++) {
+            double* action = out + a * segment_->action_doubles();
+            std::copy(actions[a].actuation.begin(), actions[a].actuation.end(), action);
+            action[h.actuation_size] = actions[a].value;
+            action[h.actuation_size + 1] = actions[a].total_error;
+            action[h.actuation_size + 2] = actions[a].visits;
+        }
+        out += h.max_actions * segment_->action_doubles();
+        for(int step = 0; step <= plan_steps; step++) {
+            std::copy(plan.states[step].begin(), plan.states[step].end(), out + step * h.state_size);
+        }
+        out += (h.max_plan_steps + 1) * h.state_size;
+        for(int step = 0; step < plan_steps; step++) {
+            std::copy(plan.actuations[step].begin(), plan.actuations[step].end(), out + step * h.actuation_size);
+        }
+
+        slot_header* s = segment_->slot(worker_index_);
+        uint64_t sequence = s->sequence.load(std::memory_order_relaxed);
+        s->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s->publications++;
+        s->action_count = actions.size();
+        s->plan_steps = plan_steps;
+        memcpy(segment_->payload(s), payload.data(), payload.size() * sizeof(double));
+        s->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    void RootParallelWorker::figure_seconds(Context& context, double seconds, double publish_interval) {
+        if(publish_interval <= 0) {
+            throw std::invalid_argument("Publish interval must be positive");
+        }
+        auto end_time = std::chrono::steady_clock::now()
+                + std::chrono::microseconds((long) (seconds * 1000000));
+        while(true) {
+            double remaining = std::chrono::duration<double>(end_time - std::chrono::steady_clock::now()).count();
+            if(remaining <= 0) {
+                break;
+            }
+            context.figure_seconds(std::min(remaining, publish_interval));
+            publish(context);
+        }
+    }
+}
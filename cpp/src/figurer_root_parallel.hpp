@@ -0,0 +1,77 @@
+#ifndef FIGURER_ROOT_PARALLEL_HPP
+#define FIGURER_ROOT_PARALLEL_HPP
+
+#include "figurer.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Root-parallel planning across processes on one host.
+ *
+ * Each worker process grows its own Context from the same initial state and
+ * periodically publishes its root actions and best plan to a POSIX shared
+ * memory segment. A coordinator process creates the segment and merges the
+ * latest publications into one Plan.
+ *
+ * Every worker owns one slot guarded by a sequence lock: the worker bumps the
+ * slot's sequence number to odd, writes, and bumps it to even. Readers copy the
+ * slot and keep the copy only if the sequence was even and unchanged, so neither
+ * side ever blocks the other. Readers give up on a slot after a bounded number
+ * of retries, so a worker that dies mid-write can't stall the coordinator.
+ */
+
+namespace figurer {
+
+    struct shared_root_segment;
+
+    // Most recent publication from one worker.
+    struct WorkerSnapshot {
+        // Number of times the worker has published.
+        long publications;
+        std::vector<RootAction> root_actions;
+        Plan plan;
+    };
+
+    class RootParallelCoordinator {
+        std::unique_ptr<shared_root_segment> segment_;
+    public:
+        // Creates the named segment. Throws if it already exists, whether another
+        // coordinator is using it or a crashed run left it behind.
+        // Root actions and plan steps beyond the given limits are not shared.
+        RootParallelCoordinator(const std::string& name, int worker_count, int state_size, int actuation_size,
+                                int max_actions = 64, int max_plan_steps = 64);
+        // Unmaps and removes the segment.
+        ~RootParallelCoordinator();
+        RootParallelCoordinator(const RootParallelCoordinator&) = delete;
+        RootParallelCoordinator& operator=(const RootParallelCoordinator&) = delete;
+        int worker_count() const;
+        // Copy the latest publication of one worker. False if the worker hasn't published
+        // yet or was mid-write on every attempt.
+        bool snapshot(int worker_index, WorkerSnapshot& snapshot) const;
+        // Root actions from all workers. Actions whose actuations are within merge_radius
+        // of a more visited action are combined into it, weighting value and error by visits.
+        std::vector<RootAction> merged_root_actions(double merge_radius = 0) const;
+        // Plan of the worker whose first actuation is closest to the most visited merged
+        // action. Visits are more robust than value, which may come from a single lucky
+        // sample. Empty if no worker has published.
+        Plan merged_plan(double merge_radius = 0) const;
+    };
+
+    class RootParallelWorker {
+        std::unique_ptr<shared_root_segment> segment_;
+        int worker_index_;
+    public:
+        // Opens a segment created by a coordinator.
+        RootParallelWorker(const std::string& name, int worker_index);
+        ~RootParallelWorker();
+        RootParallelWorker(const RootParallelWorker&) = delete;
+        RootParallelWorker& operator=(const RootParallelWorker&) = delete;
+        // Publish the context's root actions and principal variation.
+        void publish(const Context& context);
+        // Search for the given time, publishing after every publish_interval seconds.
+        void figure_seconds(Context& context, double seconds, double publish_interval);
+    };
+}
+
+#endif
@@ -1,19 +1,111 @@
 #include "figurer_spatial_index.hpp"
+#include "figurer_trace.hpp"
+#include <algorithm>
 #include <cmath>
+#include <iterator>
+#include <random>
+#include <stdexcept>
 #include <string>
 
 namespace figurer {
 
-    spatial_index::spatial_index() : dimension_{-1}, data_{} {}
+    spatial_index::spatial_index() : spatial_index(-1) {}
 
-    spatial_index::spatial_index(int dimension) : dimension_{dimension}, data_{} {}
+    spatial_index::spatial_index(int dimension) : dimension_{dimension}, ids_{}, coordinates_{},
+        projected_dimension_{0}, candidates_{0}, projection_walks_{0}, recall_sample_interval_{0},
+        approximate_lookups_{0}, recall_samples_{0}, recall_hits_{0} {}
 
-    void spatial_index::add(int id, std::vector<double> position) {
+    void spatial_index::set_approximate(int projected_dimension, int candidates, int recall_sample_interval) {
+        if(projected_dimension <= 0) {
+            projected_dimension_ = 0;
+            projection_matrix_.clear();
+            projections_.clear();
+            projection_order_.clear();
+            last_visit_.clear();
+            return;
+        }
+        if(candidates < 1) {
+            throw std::invalid_argument("Approximate spatial_index needs at least one candidate");
+        }
+        projected_dimension_ = projected_dimension;
+        candidates_ = candidates;
+        recall_sample_interval_ = recall_sample_interval;
+        if(dimension_ >= 0) {
+            build_projection();
+        }
+    }
+
+    void spatial_index::build_projection() {
+        int projected_dimension = projected_dimension_;
+        // Gaussian projection approximately preserves distances (Johnson-Lindenstrauss).
+        // Fixed seed so that searches are repeatable.
+        std::mt19937 generator(projected_dimension * 7919 + dimension_);
+        std::normal_distribution<double> normal(0.0, 1.0 / sqrt((double) projected_dimension));
+        projection_matrix_.resize(projected_dimension * dimension_);
+        for(auto& entry : projection_matrix_) {
+            entry = normal(generator);
+        }
+        projections_.resize(ids_.size() * projected_dimension);
+        projection_order_.assign(projected_dimension, {});
+        last_visit_.assign(ids_.size(), 0);
+        for(size_t i = 0; i < ids_.size(); i++) {
+            auto begin = coordinates_.begin() + i * dimension_;
+            project(std::vector<double>(begin, begin + dimension_), &projections_[i * projected_dimension]);
+            add_projection_order(i);
+        }
+    }
+
+    void spatial_index::add_projection_order(int index) {
+        for(int k = 0; k < projected_dimension_; k++) {
+            projection_order_[k].emplace(projections_[index * projected_dimension_ + k], index);
+        }
+    }
+
+    void spatial_index::clear() {
+        ids_.clear();
+        coordinates_.clear();
+        projections_.clear();
+        for(auto& order : projection_order_) {
+            order.clear();
+        }
+        last_visit_.clear();
+    }
+
+    long spatial_index::recall_samples() const {
+        return recall_samples_;
+    }
+
+    long spatial_index::recall_hits() const {
+        return recall_hits_;
+    }
+
+    void spatial_index::project(const std::vector<double>& position, real_t* projection) const {
+        for(int k = 0; k < projected_dimension_; k++) {
+            const real_t* row = &projection_matrix_[k * dimension_];
+            real_t sum = 0;
+            for(int j = 0; j < dimension_; j++) {
+                sum += row[j] * position[j];
+            }
+            projection[k] = sum;
+        }
+    }
+
+    void spatial_index::add(int id, const std::vector<double>& position) {
         if(dimension_ < 0) {
             dimension_ = position.size();
+            if(projected_dimension_ > 0) {
+                build_projection();
+            }
         }
         if(position.size() == dimension_) {
-            data_.emplace_back(id,position);
+            ids_.push_back(id);
+            coordinates_.insert(coordinates_.end(), position.begin(), position.end());
+            if(projected_dimension_ > 0) {
+                projections_.resize(ids_.size() * projected_dimension_);
+                project(position, &projections_[(ids_.size() - 1) * projected_dimension_]);
+                last_visit_.push_back(0);
+                add_projection_order(ids_.size() - 1);
+            }
         } else {
             throw std::invalid_argument("Adding vector of dimension " + std::to_string(position.size()) +
                                         " to spatial_index of dimension " + std::to_string(dimension_));
@@ -21,23 +113,174 @@ namespace figurer {
     }
 
     std::pair<int,std::vector<double>> spatial_index::closest(const std::vector<double>& position) {
-        if(data_.empty()) {
+        FIGURER_TRACE_SCOPE("spatial_index::closest");
+        if(ids_.empty()) {
             throw std::invalid_argument("Can't find closest point in empty data set");
         }
         if(position.size() != dimension_) {
             throw std::invalid_argument("Searching for vector of dimension " + std::to_string(position.size()) +
                                         " tin spatial_index of dimension " + std::to_string(dimension_));
         }
-        int closest_index = 0;
-        double closest_distance = distance2(position, data_[0].second);
-        for(int i = 1; i < data_.size(); i++) {
-            double dist = distance2(position, data_[i].second);
-            if(dist < closest_distance) {
+        // Scan in storage precision so that single precision builds get twice the vector width.
+        const stored_vector& query = to_stored(position);
+        int closest_index;
+        if(projected_dimension_ > 0 && (size_t) candidates_ < ids_.size()) {
+            closest_index = closest_approximate(position, query);
+        } else {
+            closest_index = closest_exact(query);
+        }
+        auto begin = coordinates_.begin() + closest_index * dimension_;
+        return {ids_[closest_index], std::vector<double>(begin, begin + dimension_)};
+    }
+
+    std::vector<std::pair<int,std::vector<double>>> spatial_index::closest_k(const std::vector<double>& position, int k) {
+        FIGURER_TRACE_SCOPE("spatial_index::closest_k");
+        if(ids_.empty()) {
+            throw std::invalid_argument("Can't find closest point in empty data set");
+        }
+        if(position.size() != (size_t) dimension_) {
+            throw std::invalid_argument("Searching for vector of dimension " + std::to_string(position.size()) +
+                                        " in spatial_index of dimension " + std::to_string(dimension_));
+        }
+        const stored_vector& query = to_stored(position);
+        if(projected_dimension_ > 0 && (size_t) candidates_ < ids_.size()) {
+            // Rank projected candidates by their full distance and keep the closest k.
+            collect_candidates(position, std::max(candidates_, k));
+            for(auto& candidate : candidate_heap_) {
+                const real_t* coordinates = &coordinates_[candidate.second * dimension_];
+                real_t dist = 0;
+                for(int j = 0; j < dimension_; j++) {
+                    real_t diff = query[j] - coordinates[j];
+                    dist += diff * diff;
+                }
+                candidate.first = dist;
+            }
+            std::sort(candidate_heap_.begin(), candidate_heap_.end());
+            if(candidate_heap_.size() > (size_t) k) {
+                candidate_heap_.resize(k);
+            }
+        } else {
+            // Max heap on distance holding the closest positions seen so far.
+            candidate_heap_.clear();
+            for(size_t i = 0; i < ids_.size(); i++) {
+                const real_t* coordinates = &coordinates_[i * dimension_];
+                real_t dist = 0;
+                for(int j = 0; j < dimension_; j++) {
+                    real_t diff = query[j] - coordinates[j];
+                    dist += diff * diff;
+                }
+                if(candidate_heap_.size() < (size_t) k) {
+                    candidate_heap_.emplace_back(dist, i);
+                    std::push_heap(candidate_heap_.begin(), candidate_heap_.end());
+                } else if(dist < candidate_heap_.front().first) {
+                    std::pop_heap(candidate_heap_.begin(), candidate_heap_.end());
+                    candidate_heap_.back() = {dist, i};
+                    std::push_heap(candidate_heap_.begin(), candidate_heap_.end());
+                }
+            }
+            std::sort_heap(candidate_heap_.begin(), candidate_heap_.end());
+        }
+        std::vector<std::pair<int,std::vector<double>>> result;
+        for(auto& candidate : candidate_heap_) {
+            auto begin = coordinates_.begin() + candidate.second * dimension_;
+            result.emplace_back(ids_[candidate.second], std::vector<double>(begin, begin + dimension_));
+        }
+        return result;
+    }
+
+    int spatial_index::closest_exact(const stored_vector& query) const {
+        size_t closest_index = 0;
+        real_t closest_distance = 0;
+        for(size_t i = 0; i < ids_.size(); i++) {
+            const real_t* coordinates = &coordinates_[i * dimension_];
+            real_t dist = 0;
+            for(int j = 0; j < dimension_; j++) {
+                real_t diff = query[j] - coordinates[j];
+                dist += diff * diff;
+            }
+            if(i == 0 || dist < closest_distance) {
                 closest_distance = dist;
                 closest_index = i;
             }
         }
-        return data_[closest_index];
+        return closest_index;
+    }
+
+    void spatial_index::collect_candidates(const std::vector<double>& position, int count) {
+        std::vector<real_t> query_projection(projected_dimension_);
+        project(position, query_projection.data());
+        projection_walks_++;
+        // Max heap on projected distance holding the best candidates seen so far.
+        candidate_heap_.clear();
+        for(int k = 0; k < projected_dimension_; k++) {
+            // Walk outwards from the query along this coordinate, nearer side first.
+            const auto& order = projection_order_[k];
+            real_t value = query_projection[k];
+            auto above = order.lower_bound(value);
+            auto below = above;
+            for(int taken = 0; taken < count && (above != order.end() || below != order.begin()); taken++) {
+                int i;
+                if(below == order.begin() || (above != order.end() && above->first - value <= value - std::prev(below)->first)) {
+                    i = above->second;
+                    ++above;
+                } else {
+                    --below;
+                    i = below->second;
+                }
+                if(last_visit_[i] == projection_walks_) {
+                    continue;
+                }
+                last_visit_[i] = projection_walks_;
+                const real_t* projection = &projections_[i * projected_dimension_];
+                real_t dist = 0;
+                for(int l = 0; l < projected_dimension_; l++) {
+                    real_t diff = query_projection[l] - projection[l];
+                    dist += diff * diff;
+                }
+                if(candidate_heap_.size() < (size_t) count) {
+                    candidate_heap_.emplace_back(dist, i);
+                    std::push_heap(candidate_heap_.begin(), candidate_heap_.end());
+                } else if(dist < candidate_heap_.front().first) {
+                    std::pop_heap(candidate_heap_.begin(), candidate_heap_.end());
+                    candidate_heap_.back() = {dist, i};
+                    std::push_heap(candidate_heap_.begin(), candidate_heap_.end());
+                }
+            }
+        }
+    }
+
+    int spatial_index::closest_approximate(const std::vector<double>& position, const stored_vector& query) {
+        approximate_lookups_++;
+        collect_candidates(position, candidates_);
+        int closest_index = -1;
+        real_t closest_distance = 0;
+        for(auto& candidate : candidate_heap_) {
+            const real_t* coordinates = &coordinates_[candidate.second * dimension_];
+            real_t dist = 0;
+            for(int j = 0; j < dimension_; j++) {
+                real_t diff = query[j] - coordinates[j];
+                dist += diff * diff;
+            }
+            if(closest_index < 0 || dist < closest_distance) {
+                closest_distance = dist;
+                closest_index = candidate.second;
+            }
+        }
+        if(recall_sample_interval_ > 0 && approximate_lookups_ % recall_sample_interval_ == 0) {
+            recall_samples_++;
+            int exact_index = closest_exact(query);
+            // Ties count as hits since either answer is equally close.
+            const real_t* exact = &coordinates_[exact_index * dimension_];
+            real_t exact_distance = 0;
+            for(int j = 0; j < dimension_; j++) {
+                real_t diff = query[j] - exact[j];
+                exact_distance += diff * diff;
+            }
+            if(closest_distance <= exact_distance) {
+                recall_hits_++;
+            }
+        }
+        return closest_index;
     }
 
     double spatial_index::closest_distance(const std::vector<double>& position) {
@@ -50,7 +293,7 @@ namespace figurer {
     }
 
     int spatial_index::size() {
-        return data_.size();
+        return ids_.size();
     }
 
     double distance(const std::vector<double>& position1, const std::vector<double>& position2) {
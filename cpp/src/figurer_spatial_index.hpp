@@ -1,17 +1,60 @@
 #ifndef FIGURER_FIGURER_SPATIAL_INDEX_HPP
 #define FIGURER_FIGURER_SPATIAL_INDEX_HPP
 
+#include "figurer_precision.hpp"
+#include <map>
 #include <vector>
 
 namespace figurer {
     class spatial_index {
         int dimension_;
-        std::vector<std::pair<int,std::vector<double>>> data_;
+        // Positions are stored contiguously, dimension_ coordinates per id.
+        std::vector<int> ids_;
+        std::vector<real_t> coordinates_;
+        // Approximate mode: each position is also stored as a random projection to
+        // projected_dimension_ coordinates, and every projected coordinate keeps the
+        // positions sorted by its value. Lookups take the candidates_ positions nearest
+        // the query along each sorted coordinate, rank those by projected distance and
+        // then the best candidates_ exactly. Projected dimension of zero is exact mode.
+        int projected_dimension_;
+        int candidates_;
+        std::vector<real_t> projection_matrix_;
+        std::vector<real_t> projections_;
+        std::vector<std::multimap<real_t,int>> projection_order_;
+        // Walk of the sorted coordinates in which each position was last considered, so
+        // that it is ranked only once per lookup.
+        std::vector<long> last_visit_;
+        long projection_walks_;
+        // Every recall_sample_interval_ approximate lookups are checked against an exact scan.
+        int recall_sample_interval_;
+        long approximate_lookups_;
+        long recall_samples_;
+        long recall_hits_;
+        // Reused between lookups to avoid allocating.
+        std::vector<std::pair<real_t,int>> candidate_heap_;
+        void build_projection();
+        void add_projection_order(int index);
+        void project(const std::vector<double>& position, real_t* projection) const;
+        int closest_exact(const stored_vector& query) const;
+        // Fill candidate_heap_ with up to count positions closest by projected distance.
+        void collect_candidates(const std::vector<double>& position, int count);
+        int closest_approximate(const std::vector<double>& position, const stored_vector& query);
     public:
         spatial_index();
         spatial_index(int dimension);
-        void add(int id, std::vector<double> position);
+        // Compare only candidates nearest along random projections, checking one in
+        // recall_sample_interval lookups exactly. Projected dimension of zero is exact.
+        void set_approximate(int projected_dimension, int candidates, int recall_sample_interval = 100);
+        // Remove all positions but keep configuration and recall measurements.
+        void clear();
+        // Lookups checked against an exact scan, and how many of those found the true closest.
+        long recall_samples() const;
+        long recall_hits() const;
+        void add(int id, const std::vector<double>& position);
         std::pair<int,std::vector<double>> closest(const std::vector<double>& position);
+        // Up to k closest positions, nearest first. In approximate mode the closest of at
+        // least k projected candidates, so the same recall trade-off applies.
+        std::vector<std::pair<int,std::vector<double>>> closest_k(const std::vector<double>& position, int k);
         double closest_distance(const std::vector<double>& position);
         double closest_distance2(const std::vector<double>& position);
         int size();
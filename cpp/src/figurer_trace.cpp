@@ -0,0 +1,153 @@
+#include "figurer_trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace figurer {
+
+    namespace {
+        // Slot fields are atomic so that a dump can read while the owning thread writes.
+        // Sequence is the event index plus one once the event is complete, and 0 while
+        // it is being written, so a dump can drop events torn by a concurrent write.
+        struct trace_slot {
+            std::atomic<uint64_t> sequence;
+            std::atomic<const char*> name;
+            std::atomic<int64_t> start_ns;
+            std::atomic<int64_t> duration_ns;
+        };
+
+        struct trace_buffer {
+            int thread_index;
+            long generation;
+            std::unique_ptr<trace_slot[]> slots;
+            uint64_t capacity;
+            // Total events written. Only the owning thread increments it.
+            std::atomic<uint64_t> written;
+        };
+
+        std::mutex registry_mutex;
+        std::vector<std::shared_ptr<trace_buffer>> registry;
+        // Incremented by clear_trace so that each thread starts a fresh buffer.
+        std::atomic<long> generation{0};
+        std::atomic<int> events_per_thread{65536};
+        std::atomic<int> next_thread_index{0};
+        thread_local std::shared_ptr<trace_buffer> local_buffer;
+        const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+        int this_thread_index() {
+            thread_local int index = next_thread_index++;
+            return index;
+        }
+
+        trace_buffer& buffer_for_this_thread() {
+            long current_generation = generation.load(std::memory_order_acquire);
+            if(!local_buffer || local_buffer->generation != current_generation) {
+                auto buffer = std::make_shared<trace_buffer>();
+                buffer->thread_index = this_thread_index();
+                buffer->generation = current_generation;
+                buffer->capacity = std::max(1, events_per_thread.load());
+                buffer->slots.reset(new trace_slot[buffer->capacity]());
+                buffer->written = 0;
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                registry.push_back(buffer);
+                local_buffer = buffer;
+            }
+            return *local_buffer;
+        }
+
+        void write_json_string(std::ostream& os, const char* text) {
+            os << '"';
+            for(const char* c = text; *c; c++) {
+                if(*c == '"' || *c == '\\') {
+                    os << '\\';
+                }
+                os << *c;
+            }
+            os << '"';
+        }
+    }
+
+    namespace trace_internal {
+        std::atomic<bool> enabled{false};
+
+        int64_t now_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - epoch).count();
+        }
+
+        void record(const char* name, int64_t start_ns, int64_t end_ns) {
+            trace_buffer& buffer = buffer_for_this_thread();
+            uint64_t index = buffer.written.load(std::memory_order_relaxed);
+            trace_slot& slot = buffer.slots[index % buffer.capacity];
+            slot.sequence.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.start_ns.store(start_ns, std::memory_order_relaxed);
+            slot.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+            slot.sequence.store(index + 1, std::memory_order_release);
+            buffer.written.store(index + 1, std::memory_order_release);
+        }
+    }
+
+    void enable_tracing(int events_per_thread_limit) {
+        if(events_per_thread_limit != events_per_thread) {
+            events_per_thread = events_per_thread_limit;
+            clear_trace();
+        }
+        trace_internal::enabled = true;
+    }
+
+    void disable_tracing() {
+        trace_internal::enabled = false;
+    }
+
+    void clear_trace() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.clear();
+        generation++;
+    }
+
+    void write_chrome_trace(std::ostream& os) {
+        std::vector<std::shared_ptr<trace_buffer>> buffers;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            buffers = registry;
+        }
+        std::ios_base::fmtflags oldflags = os.flags();
+        std::streamsize oldprecision = os.precision();
+        os << std::fixed << std::setprecision(3);
+        os << "{\"traceEvents\":[";
+        bool first_event = true;
+        for(auto& buffer : buffers) {
+            uint64_t written = buffer->written.load(std::memory_order_acquire);
+            uint64_t begin = written > buffer->capacity ? written - buffer->capacity : 0;
+            for(uint64_t i = begin; i < written; i++) {
+                trace_slot& slot = buffer->slots[i % buffer->capacity];
+                uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+                trace_event event{slot.name.load(std::memory_order_relaxed),
+                                  slot.start_ns.load(std::memory_order_relaxed),
+                                  slot.duration_ns.load(std::memory_order_relaxed)};
+                // Skip events that the owning thread overwrote or was writing while we copied.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(sequence != i + 1 || slot.sequence.load(std::memory_order_relaxed) != sequence) {
+                    continue;
+                }
+                if(!first_event) {
+                    os << ",";
+                }
+                first_event = false;
+                os << "\n{\"name\":";
+                write_json_string(os, event.name);
+                os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_index
+                   << ",\"ts\":" << event.start_ns / 1000.0
+                   << ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+            }
+        }
+        os << "\n]}\n";
+        os.flags(oldflags);
+        os.precision(oldprecision);
+    }
+}
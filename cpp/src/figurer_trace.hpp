@@ -0,0 +1,70 @@
+#ifndef FIGURER_TRACE_HPP
+#define FIGURER_TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+/*
+ * Timeline tracing of search phases and user callbacks.
+ *
+ * Tracing is off until enable_tracing is called. Each thread records complete
+ * events into its own fixed-size ring buffer without locking, keeping only the
+ * most recent events. write_chrome_trace dumps all threads in Chrome trace
+ * JSON, which chrome://tracing and Perfetto can open.
+ *
+ * Define FIGURER_DISABLE_TRACING to compile out all trace scopes.
+ */
+
+namespace figurer {
+
+    struct trace_event {
+        // Must point to a string literal or other storage that outlives the trace.
+        const char* name;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    namespace trace_internal {
+        extern std::atomic<bool> enabled;
+        int64_t now_ns();
+        void record(const char* name, int64_t start_ns, int64_t end_ns);
+    }
+
+    // Start recording, keeping up to events_per_thread recent events per thread.
+    void enable_tracing(int events_per_thread = 65536);
+    void disable_tracing();
+    // Discard all recorded events.
+    void clear_trace();
+    // Events recorded so far. Safe to call while other threads are recording,
+    // though events written during the dump may be left out.
+    void write_chrome_trace(std::ostream& os);
+
+    class trace_scope {
+        const char* name_;
+        int64_t start_ns_;
+    public:
+        explicit trace_scope(const char* name) : name_{name}, start_ns_{-1} {
+            if(trace_internal::enabled.load(std::memory_order_relaxed)) {
+                start_ns_ = trace_internal::now_ns();
+            }
+        }
+        ~trace_scope() {
+            if(start_ns_ >= 0) {
+                trace_internal::record(name_, start_ns_, trace_internal::now_ns());
+            }
+        }
+        trace_scope(const trace_scope&) = delete;
+        trace_scope& operator=(const trace_scope&) = delete;
+    };
+}
+
+#define FIGURER_TRACE_CONCAT_INNER(a, b) a##b
+#define FIGURER_TRACE_CONCAT(a, b) FIGURER_TRACE_CONCAT_INNER(a, b)
+#ifdef FIGURER_DISABLE_TRACING
+#define FIGURER_TRACE_SCOPE(name)
+#else
+#define FIGURER_TRACE_SCOPE(name) figurer::trace_scope FIGURER_TRACE_CONCAT(figurer_trace_scope_, __LINE__)(name)
+#endif
+
+#endif
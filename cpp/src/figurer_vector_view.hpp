@@ -0,0 +1,29 @@
+#ifndef FIGURER_VECTOR_VIEW_HPP
+#define FIGURER_VECTOR_VIEW_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace figurer {
+
+    // Non-owning view of contiguous doubles, standing in for std::span<const double>
+    // until the library moves to C++20. Callbacks taking vector_view read states and
+    // actuations in place instead of receiving a heap-allocated copy.
+    class vector_view {
+        const double* data_;
+        size_t size_;
+    public:
+        vector_view(const double* data, size_t size) : data_{data}, size_{size} {}
+        // Explicit so that a view of a temporary vector is never created implicitly.
+        explicit vector_view(const std::vector<double>& values) : data_{values.data()}, size_{values.size()} {}
+        const double* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        const double& operator[](size_t index) const { return data_[index]; }
+        const double* begin() const { return data_; }
+        const double* end() const { return data_ + size_; }
+        std::vector<double> to_vector() const { return std::vector<double>(data_, data_ + size_); }
+    };
+}
+
+#endif
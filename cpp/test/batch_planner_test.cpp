@@ -0,0 +1,51 @@
+#include "figurer_batch_planner.hpp"
+#include "figurer_robot2d_example.hpp"
+#include "gtest/gtest.h"
+#include <atomic>
+
+namespace {
+    TEST(FigurerBatchPlannerTest, IterationsOnEveryContext) {
+        std::vector<figurer::Context> contexts;
+        for(int i = 0; i < 8; i++) {
+            contexts.push_back(figurer_robot2d_example::robot2d_context());
+        }
+        figurer::BatchPlanner planner(3);
+        for(auto& context : contexts) {
+            planner.add_context(context);
+        }
+        std::atomic<int> reports{0};
+        planner.set_progress_fn([&reports](int context_index, const figurer::BatchProgress& progress) {
+            reports++;
+        });
+        planner.figure_iterations(50);
+        for(int i = 0; i < planner.context_count(); i++) {
+            figurer::BatchProgress progress = planner.progress(i);
+            EXPECT_EQ(50, progress.iterations);
+            EXPECT_TRUE(progress.finished);
+            EXPECT_GT(progress.total_error, 0.0);
+        }
+        // Default of 10 iterations per task gives 5 tasks per context.
+        EXPECT_EQ(8 * 5, reports);
+        std::vector<figurer::Plan> plans = planner.sample_plans();
+        EXPECT_EQ(8, plans.size());
+        // Sampled plans can end early at a reused leaf, so only check that each has a first step.
+        for(auto& plan : plans) {
+            EXPECT_FALSE(plan.actuations.empty());
+        }
+    }
+
+    TEST(FigurerBatchPlannerTest, SharedDeadline) {
+        std::vector<figurer::Context> contexts;
+        for(int i = 0; i < 4; i++) {
+            contexts.push_back(figurer_robot2d_example::robot2d_context());
+        }
+        figurer::BatchPlanner planner(2);
+        for(auto& context : contexts) {
+            planner.add_context(context);
+        }
+        planner.figure_seconds(0.05);
+        for(int i = 0; i < planner.context_count(); i++) {
+            EXPECT_GT(planner.progress(i).iterations, 0);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#include "figurer_callback_cache.hpp"
+#include "figurer_robot2d_example.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+    TEST(FigurerCallbackCacheTest, QuantizedLookup) {
+        figurer::callback_cache<int> cache;
+        cache.configure(2, 0.1);
+        int calls = 0;
+        auto compute = [&calls]() { return ++calls; };
+        EXPECT_EQ(1, cache.lookup(figurer::quantize({1.0, 2.0}, 0.1), compute));
+        EXPECT_EQ(1, cache.lookup(figurer::quantize({1.01, 1.99}, 0.1), compute));
+        EXPECT_EQ(2, cache.lookup(figurer::quantize({1.5, 2.0}, 0.1), compute));
+        EXPECT_EQ(1, cache.hits());
+        EXPECT_EQ(2, cache.misses());
+    }
+
+    TEST(FigurerCallbackCacheTest, LeastRecentlyUsedEviction) {
+        figurer::callback_cache<int> cache;
+        cache.configure(2, 1.0);
+        int calls = 0;
+        auto compute = [&calls]() { return ++calls; };
+        cache.lookup(figurer::quantize({1.0}, 1.0), compute);
+        cache.lookup(figurer::quantize({2.0}, 1.0), compute);
+        cache.lookup(figurer::quantize({1.0}, 1.0), compute);
+        cache.lookup(figurer::quantize({3.0}, 1.0), compute);
+        EXPECT_EQ(2, cache.size());
+        // {2.0} was least recently used so it was evicted, while {1.0} survived.
+        EXPECT_EQ(1, cache.lookup(figurer::quantize({1.0}, 1.0), compute));
+        EXPECT_EQ(4, cache.lookup(figurer::quantize({2.0}, 1.0), compute));
+    }
+
+    TEST(FigurerCallbackCacheTest, ContextCountsHits) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.set_callback_cache(1000, 0.5);
+        context.figure_iterations(100);
+        figurer::SearchStats stats = context.stats();
+        EXPECT_GT(stats.policy_cache_hits, 0);
+        EXPECT_GT(stats.predict_cache_hits, 0);
+        EXPECT_GT(stats.predict_cache_misses, 0);
+    }
+}
@@ -0,0 +1,75 @@
+#include "figurer_concurrent_spatial_index.hpp"
+#include "figurer_spatial_index.hpp"
+#include "gtest/gtest.h"
+#include <random>
+#include <thread>
+
+namespace {
+    TEST(FigurerConcurrentSpatialIndexTest, Closest) {
+        // Tiny chunks so that lookups cross several of them.
+        figurer::concurrent_spatial_index index(3, 5.0, 64, 2);
+        index.add(101, std::vector<double>{10,20,30});
+        index.add(102, std::vector<double>{20,30,40});
+        index.add(103, std::vector<double>{30,40,50});
+        index.add(104, std::vector<double>{40,20,30});
+        index.add(105, std::vector<double>{20,40,30});
+        auto found = index.closest(std::vector<double>{41,19,29});
+        EXPECT_EQ(104, found.first);
+        EXPECT_EQ(5, index.size());
+        EXPECT_THROW(index.add(106, std::vector<double>{1,2}), std::invalid_argument);
+    }
+
+    TEST(FigurerConcurrentSpatialIndexTest, MatchesExactSearch) {
+        // Few buckets force the full scan fallback for distant queries.
+        for(long bucket_count : {16L, 1L << 16}) {
+            std::mt19937 generator(1);
+            std::uniform_real_distribution<double> coordinate(-10.0, 10.0);
+            figurer::concurrent_spatial_index index(5, 1.0, bucket_count);
+            figurer::spatial_index exact(5);
+            for(int i = 0; i < 1000; i++) {
+                std::vector<double> point;
+                for(int j = 0; j < 5; j++) {
+                    point.push_back(coordinate(generator));
+                }
+                index.add(i, point);
+                exact.add(i, point);
+            }
+            for(int i = 0; i < 100; i++) {
+                // Some queries fall far outside the points.
+                std::vector<double> query;
+                for(int j = 0; j < 5; j++) {
+                    query.push_back(3 * coordinate(generator));
+                }
+                EXPECT_EQ(exact.closest(query).first, index.closest(query).first);
+            }
+        }
+    }
+
+    TEST(FigurerConcurrentSpatialIndexTest, ConcurrentAddAndClosest) {
+        const int thread_count = 4;
+        const int points_per_thread = 500;
+        figurer::concurrent_spatial_index index(2, 4.0, 1024, 16);
+        index.add(-1, std::vector<double>{-1000, -1000});
+        std::vector<std::thread> threads;
+        for(int t = 0; t < thread_count; t++) {
+            threads.emplace_back([&index, t]() {
+                for(int i = 0; i < points_per_thread; i++) {
+                    int id = t * points_per_thread + i;
+                    index.add(id, std::vector<double>{(double) t, (double) i});
+                    // A thread always sees its own completed inserts.
+                    auto found = index.closest(std::vector<double>{(double) t, (double) i});
+                    ASSERT_EQ(id, found.first);
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        EXPECT_EQ(thread_count * points_per_thread + 1, index.size());
+        for(int t = 0; t < thread_count; t++) {
+            for(int i = 0; i < points_per_thread; i += 50) {
+                EXPECT_EQ(t * points_per_thread + i, index.closest(std::vector<double>{t + 0.1, i + 0.1}).first);
+            }
+        }
+    }
+}
@@ -0,0 +1,594 @@
+#include "figurer.hpp"
+#include "figurer_robot2d_example.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+
+namespace {
+    // Context on a line where each actuation in [-1, 1] moves the state by about that
+    // much. A little noise keeps every sampled state distinct.
+    figurer::Context line_context(int depth, std::function<double(std::vector<double>)> value_fn) {
+        figurer::Context context;
+        context.set_depth(depth);
+        context.set_initial_state({0.0});
+        context.set_value_fn(value_fn);
+        context.set_policy_fn([](std::vector<double> state) { return figurer::uniform_distribution({-1.0, 1.0}); });
+        context.set_predict_fn([](std::vector<double> state, std::vector<double> actuation) {
+            return figurer::uniform_distribution({state[0] + actuation[0] - 0.001, state[0] + actuation[0] + 0.001});
+        });
+        return context;
+    }
+
+    // Policy with constant density that proposes scripted actuations in order.
+    // The first proposal is used up when the context validates callbacks.
+    figurer::Distribution scripted_policy(std::vector<double> actuations) {
+        auto next = std::make_shared<int>(0);
+        figurer::Distribution distribution;
+        distribution.set_dimension(1);
+        distribution.set_sample_fn([next, actuations](std::vector<double> seed) {
+            int index = std::min<int>((*next)++, actuations.size() - 1);
+            return std::vector<double>{actuations[index]};
+        });
+        distribution.set_density_fn([](std::vector<double> actuation) { return 1.0; });
+        return distribution;
+    }
+
+    TEST(FigurerContextTest, CompactKeepsReachableNodes) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.figure_iterations(100);
+        figurer::SearchStats before = context.stats();
+        context.compact();
+        figurer::SearchStats after = context.stats();
+        EXPECT_EQ(before.state_nodes, after.state_nodes);
+        EXPECT_EQ(before.distribution_nodes, after.distribution_nodes);
+        // Search continues normally on the compacted tree.
+        context.figure_iterations(100);
+        EXPECT_GE(context.stats().distribution_nodes, after.distribution_nodes);
+        figurer::Plan plan = context.sample_plan();
+        EXPECT_FALSE(plan.actuations.empty());
+    }
+
+    TEST(FigurerContextTest, CompactDiscardsUnreachableNodes) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.figure_iterations(50);
+        context.set_initial_state({-5, -5});
+        context.figure_iterations(0);
+        EXPECT_GT(context.stats().state_nodes, 1);
+        context.compact();
+        EXPECT_EQ(1, context.stats().state_nodes);
+        EXPECT_EQ(0, context.stats().distribution_nodes);
+    }
+
+    TEST(FigurerContextTest, CompactionInterval) {
+        figurer::Context context = line_context(3, [](std::vector<double> state) { return -fabs(state[0]); });
+        context.set_compaction_interval(10);
+        context.figure_iterations(100);
+        figurer::SearchStats before = context.stats();
+        // Moving the root far away leaves the old tree unreachable. It is kept until
+        // the compaction after the 10th iteration from the new root.
+        context.set_initial_state({1000.0});
+        context.figure_iterations(9);
+        figurer::SearchStats pending = context.stats();
+        EXPECT_GT(pending.state_nodes, before.state_nodes);
+        context.figure_iterations(1);
+        figurer::SearchStats after = context.stats();
+        EXPECT_LE(after.state_nodes, pending.state_nodes + 3 - before.state_nodes);
+        EXPECT_LT(after.state_nodes, before.state_nodes);
+        figurer::Plan plan = context.sample_plan();
+        EXPECT_FALSE(plan.actuations.empty());
+    }
+
+    TEST(FigurerContextTest, CompactionReleasesTreeMemory) {
+        figurer::Context context = line_context(3, [](std::vector<double> state) { return -fabs(state[0]); });
+        context.set_compaction_interval(50);
+        // Each root is far from the last, so each compaction drops the whole previous tree.
+        // Without rebuilding the arena, memory would keep growing with every new root.
+        size_t early_peak = 0;
+        for(int i = 0; i < 40; i++) {
+            context.set_initial_state({1000.0 * i});
+            context.figure_iterations(100);
+            size_t bytes = context.stats().tree_memory_bytes;
+            EXPECT_GT(bytes, 0u);
+            if(i < 10) {
+                early_peak = std::max(early_peak, bytes);
+            } else {
+                EXPECT_LE(bytes, 2 * early_peak);
+            }
+        }
+    }
+
+    TEST(FigurerContextTest, ApproximateStateIndex) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        // Aiming can stop the tree from growing, leaving too few lookups to sample recall.
+        context.set_predict_inverse_fn(nullptr);
+        context.set_approximate_state_index(2, 4);
+        context.figure_iterations(1000);
+        figurer::SearchStats stats = context.stats();
+        EXPECT_GT(stats.neighbor_recall_samples, 0);
+        EXPECT_LE(stats.neighbor_recall_hits, stats.neighbor_recall_samples);
+        figurer::Plan plan = context.sample_plan();
+        EXPECT_FALSE(plan.actuations.empty());
+    }
+
+    TEST(FigurerContextTest, ResetKeepsConfiguration) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.figure_iterations(100);
+        figurer::Context copy = context;
+        context.reset({-5, -5});
+        EXPECT_EQ(0, context.stats().state_nodes);
+        EXPECT_EQ(0, context.stats().distribution_nodes);
+        for(int cycle = 0; cycle < 3; cycle++) {
+            context.figure_iterations(100);
+            EXPECT_GT(context.stats().state_nodes, 1);
+            figurer::Plan plan = context.sample_plan();
+            EXPECT_EQ((std::vector<double>{-5, -5}), plan.states[0]);
+            EXPECT_FALSE(plan.actuations.empty());
+            context.reset({-5, -5});
+        }
+        // A copy has its own tree memory, so resetting the original leaves it intact.
+        copy.figure_iterations(100);
+        EXPECT_FALSE(copy.sample_plan().actuations.empty());
+    }
+
+    TEST(FigurerContextTest, CopiesAllocateFromOwnTreeMemory) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.figure_iterations(100);
+        figurer::Context copy = context;
+        // Copied nodes are rebuilt in the copy's arena rather than on the default heap.
+        EXPECT_GT(copy.stats().tree_memory_bytes, 0u);
+        EXPECT_EQ(context.stats().state_nodes, copy.stats().state_nodes);
+        copy = context;
+        EXPECT_EQ(context.stats().state_nodes, copy.stats().state_nodes);
+        copy.figure_iterations(100);
+        EXPECT_FALSE(copy.sample_plan().actuations.empty());
+    }
+
+    TEST(FigurerContextTest, MoveTakesTree) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.figure_iterations(100);
+        figurer::SearchStats before = context.stats();
+        figurer::Context moved = std::move(context);
+        // The nodes and the arena holding them change hands without copying.
+        EXPECT_EQ(before.state_nodes, moved.stats().state_nodes);
+        EXPECT_EQ(before.tree_memory_bytes, moved.stats().tree_memory_bytes);
+        EXPECT_EQ(0, context.stats().state_nodes);
+        EXPECT_EQ(0u, context.stats().tree_memory_bytes);
+        moved.figure_iterations(100);
+        EXPECT_FALSE(moved.sample_plan().actuations.empty());
+        figurer::Context assigned;
+        assigned = std::move(moved);
+        EXPECT_EQ(0, moved.stats().state_nodes);
+        assigned.figure_iterations(100);
+        EXPECT_FALSE(assigned.sample_plan().actuations.empty());
+    }
+
+    TEST(FigurerContextTest, AimAtNearestCandidates) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        int inverse_calls = 0;
+        context.set_predict_inverse_fn([&inverse_calls](figurer::vector_view state1, figurer::vector_view state2,
+                                                        std::vector<double>& actuation) {
+            inverse_calls++;
+            actuation = figurer_robot2d_example::predict_inverse_fn(state1.to_vector(), state2.to_vector());
+        });
+        context.set_aiming(4, 0.25, 0.1);
+        context.figure_iterations(200);
+        figurer::SearchStats stats = context.stats();
+        EXPECT_GT(stats.aimed_expansions, 0);
+        // Several targets are tried for some expansions.
+        EXPECT_GT(inverse_calls, stats.distribution_nodes);
+        EXPECT_FALSE(context.sample_plan().actuations.empty());
+        EXPECT_THROW(context.set_aiming(0), std::invalid_argument);
+    }
+
+    TEST(FigurerContextTest, AimWithBatchedModels) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        int inverse_calls = 0;
+        int predict_calls = 0;
+        size_t most_targets = 0;
+        size_t most_actuations = 0;
+        context.set_predict_inverse_fn(nullptr);
+        context.set_predict_inverse_batch_fn([&](figurer::vector_view state,
+                                                 const std::vector<figurer::vector_view>& targets,
+                                                 std::vector<std::vector<double>>& actuations) {
+            inverse_calls++;
+            most_targets = std::max(most_targets, targets.size());
+            for(size_t i = 0; i < targets.size(); i++) {
+                actuations[i] = figurer_robot2d_example::predict_inverse_fn(state.to_vector(), targets[i].to_vector());
+            }
+        });
+        context.set_predict_batch_fn([&](figurer::vector_view state, const std::vector<figurer::vector_view>& actuations,
+                                         std::vector<figurer::Distribution>& distributions) {
+            predict_calls++;
+            most_actuations = std::max(most_actuations, actuations.size());
+            for(auto& actuation : actuations) {
+                distributions.push_back(figurer_robot2d_example::predict_fn(state.to_vector(), actuation.to_vector()));
+            }
+        });
+        context.set_aiming(4, 0.25, 0.1);
+        context.figure_iterations(200);
+        EXPECT_GT(context.stats().aimed_expansions, 0);
+        // At most one call of each per new actuation, each covering several targets.
+        EXPECT_LE(inverse_calls, context.stats().distribution_nodes);
+        EXPECT_LE(predict_calls, inverse_calls);
+        EXPECT_GT(most_targets, 1u);
+        EXPECT_GT(most_actuations, 1u);
+    }
+
+    TEST(FigurerContextTest, AimRejectsMisshapenBatch) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.set_predict_inverse_batch_fn([](figurer::vector_view state,
+                                                const std::vector<figurer::vector_view>& targets,
+                                                std::vector<std::vector<double>>& actuations) {
+            actuations.assign(targets.size(), std::vector<double>{0.0});
+        });
+        EXPECT_THROW(context.figure_iterations(50), std::invalid_argument);
+        context.set_predict_inverse_batch_fn([](figurer::vector_view state,
+                                                const std::vector<figurer::vector_view>& targets,
+                                                std::vector<std::vector<double>>& actuations) {
+            actuations.clear();
+        });
+        EXPECT_THROW(context.figure_iterations(50), std::invalid_argument);
+    }
+
+    TEST(FigurerContextTest, AimPrefersNovelActuations) {
+        figurer::Context context;
+        context.set_depth(1);
+        context.set_value_fn([](std::vector<double> state) { return 0.0; });
+        context.set_policy_fn([](std::vector<double> state) {
+            return scripted_policy({0.0, 2.1, 3.0});
+        });
+        context.set_predict_fn([](std::vector<double> state, std::vector<double> actuation) {
+            double next = state[0] + actuation[0];
+            return figurer::uniform_distribution({next - 0.001, next + 0.001});
+        });
+        // Only expanded states are aimed at, so leave targets at 2 and 4 as earlier roots.
+        for(double target : {2.0, 4.0}) {
+            context.set_initial_state({target});
+            context.figure_iterations(1);
+        }
+        // First child of the new root has actuation 2.1.
+        context.set_initial_state({0.0});
+        context.figure_iterations(1);
+        // Sampling 3 lands between the targets. Both are equally likely under the policy,
+        // but aiming at 2 would nearly duplicate the existing actuation.
+        context.set_predict_inverse_fn([](std::vector<double> state1, std::vector<double> state2) {
+            return std::vector<double>{state2[0] - state1[0]};
+        });
+        context.set_aiming(2);
+        context.figure_iterations(1);
+        EXPECT_EQ(1, context.stats().aimed_expansions);
+        std::vector<figurer::RootAction> actions = context.root_actions();
+        ASSERT_EQ(2, actions.size());
+        EXPECT_NEAR(2.1, actions[0].actuation[0], 0.01);
+        EXPECT_NEAR(4.0, actions[1].actuation[0], 0.01);
+    }
+
+    TEST(FigurerContextTest, PolicyOnlyCalledForExpandedNodes) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        // With depth 1 every node other than the root is a leaf.
+        context.set_depth(1);
+        int policy_calls = 0;
+        context.set_policy_fn([&policy_calls](std::vector<double> state) {
+            policy_calls++;
+            return figurer_robot2d_example::policy_fn(state);
+        });
+        context.figure_iterations(100);
+        figurer::SearchStats stats = context.stats();
+        EXPECT_GT(stats.state_nodes, 1);
+        EXPECT_EQ(1, stats.expanded_state_nodes);
+        // The root reuses the call made during validation.
+        EXPECT_EQ(1, policy_calls);
+    }
+
+    TEST(FigurerContextTest, RolloutBeyondTreeDepth) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.set_depth(30);
+        context.set_rollout_depth(3);
+        int rollout_calls = 0;
+        context.set_rollout_fn([&rollout_calls](std::vector<double> state) {
+            rollout_calls++;
+            return figurer_robot2d_example::predict_inverse_fn(state, figurer_robot2d_example::goal);
+        });
+        context.figure_iterations(50);
+        EXPECT_GT(rollout_calls, 0);
+        // Each rollout covers the 27 steps below the tree.
+        EXPECT_EQ(0, rollout_calls % 27);
+        // Each iteration creates at most one state node per tree level.
+        EXPECT_LE(context.stats().state_nodes, 1 + 3 * 50);
+    }
+
+    TEST(FigurerContextTest, FigureUntilRequiresLimit) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        figurer::StopCriteria criteria;
+        EXPECT_THROW(context.figure_until(criteria), std::invalid_argument);
+    }
+
+    TEST(FigurerContextTest, FigureUntilIterationLimit) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        figurer::StopCriteria criteria;
+        criteria.stop_on_action_separation = false;
+        criteria.max_iterations = 30;
+        figurer::FigureResult result = context.figure_until(criteria);
+        EXPECT_EQ(figurer::StopReason::IterationLimit, result.reason);
+        EXPECT_EQ(30, result.iterations);
+    }
+
+    TEST(FigurerContextTest, FigureUntilErrorThreshold) {
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        figurer::StopCriteria criteria;
+        criteria.stop_on_action_separation = false;
+        criteria.root_error_threshold = 1000000;
+        criteria.max_iterations = 100;
+        figurer::FigureResult result = context.figure_until(criteria);
+        EXPECT_EQ(figurer::StopReason::ErrorThreshold, result.reason);
+        EXPECT_EQ(1, result.iterations);
+    }
+
+    TEST(FigurerContextTest, FigureUntilActionSeparated) {
+        // Value rises steeply with position, so larger actuations are clearly better.
+        figurer::Context context = line_context(2, [](std::vector<double> state) { return 100 * state[0]; });
+        figurer::StopCriteria criteria;
+        criteria.separation_margin = 50;
+        criteria.max_iterations = 5000;
+        figurer::FigureResult result = context.figure_until(criteria);
+        EXPECT_EQ(figurer::StopReason::ActionSeparated, result.reason);
+        EXPECT_LT(result.iterations, 5000);
+    }
+
+    TEST(FigurerContextTest, VectorViewCallbacks) {
+        figurer::Context context;
+        context.set_depth(3);
+        context.set_initial_state({0.0});
+        int value_calls = 0;
+        context.set_value_fn([&value_calls](figurer::vector_view state) {
+            value_calls++;
+            return state[0];
+        });
+        context.set_policy_fn([](figurer::vector_view state) { return figurer::uniform_distribution({-1.0, 1.0}); });
+        context.set_predict_fn([](figurer::vector_view state, figurer::vector_view actuation) {
+            return figurer::uniform_distribution({state[0] + actuation[0] - 0.001, state[0] + actuation[0] + 0.001});
+        });
+        context.set_predict_inverse_fn([](figurer::vector_view state1, figurer::vector_view state2,
+                                          std::vector<double>& actuation) {
+            actuation.assign(1, state2[0] - state1[0]);
+        });
+        context.figure_iterations(200);
+        figurer::Plan plan = context.sample_plan();
+        ASSERT_FALSE(plan.actuations.empty());
+        EXPECT_EQ(1, plan.actuations[0].size());
+        EXPECT_EQ(1, plan.states[0].size());
+        EXPECT_GT(value_calls, 1);
+    }
+
+    TEST(FigurerContextTest, ClearCallbacks) {
+        figurer::Context context = line_context(3, [](std::vector<double> state) { return state[0]; });
+        context.set_predict_inverse_fn(nullptr);
+        context.set_rollout_fn(nullptr);
+        context.figure_iterations(10);
+        context.set_policy_fn(nullptr);
+        EXPECT_THROW(context.figure_iterations(1), std::invalid_argument);
+        context.set_policy_fn(std::function<figurer::Distribution(std::vector<double>)>());
+        EXPECT_THROW(context.figure_iterations(1), std::invalid_argument);
+    }
+
+    TEST(FigurerContextTest, PriorPlanGuidesProposals) {
+        figurer::Context context = line_context(3, [](std::vector<double> state) { return -fabs(state[0]); });
+        figurer::Plan prior;
+        prior.actuations = {{0.9}, {0.4}, {-0.3}, {0.2}};
+        // With full weight every proposal comes from the shifted prior.
+        context.set_prior_plan(prior, 1.0, 0.01);
+        context.figure_iterations(50);
+        figurer::Plan plan = context.sample_plan();
+        ASSERT_GE(plan.actuations.size(), 1);
+        EXPECT_NEAR(0.4, plan.actuations[0][0], 0.01);
+        EXPECT_THROW(context.set_prior_plan(prior, 1.5, 0.01), std::invalid_argument);
+    }
+
+    TEST(FigurerContextTest, QuasiRandomSampling) {
+        const int strata = 8;
+        for(bool quasi_random : {true, false}) {
+            figurer::Context context = line_context(1, [](std::vector<double> state) { return state[0]; });
+            context.set_quasi_random_sampling(quasi_random);
+            for(int i = 0; i < 1000 && context.root_actions().size() < strata; i++) {
+                context.figure_iterations(1);
+            }
+            std::vector<figurer::RootAction> actions = context.root_actions();
+            ASSERT_GE(actions.size(), strata);
+            // Count the first root children in each equal stratum of [-1, 1].
+            std::vector<int> counts(strata, 0);
+            for(int a = 0; a < strata; a++) {
+                counts[std::min<int>(strata - 1, (actions[a].actuation[0] + 1) / 2 * strata)]++;
+            }
+            bool stratified = std::count(counts.begin(), counts.end(), 1) == strata;
+            // Independent samples fill every stratum once with probability 8!/8^8, about 0.2%.
+            EXPECT_EQ(quasi_random, stratified);
+        }
+    }
+
+    TEST(FigurerContextTest, SeededSearchIsRepeatable) {
+        auto seeded_search = [](uint32_t seed) {
+            figurer::Context context = figurer_robot2d_example::robot2d_context();
+            context.set_seed(seed);
+            // Other users of rand() don't affect the search.
+            srand(seed + 100);
+            context.figure_iterations(50);
+            std::vector<std::vector<double>> actuations;
+            for(auto& action : context.root_actions()) {
+                actuations.push_back(action.actuation);
+            }
+            return std::make_pair(actuations, context.sample_plan().states);
+        };
+        EXPECT_EQ(seeded_search(1), seeded_search(1));
+        EXPECT_NE(seeded_search(1), seeded_search(2));
+    }
+
+    TEST(FigurerContextTest, PruneDominatedBranches) {
+        figurer::Context context = line_context(2, [](std::vector<double> state) { return 100 * state[0]; });
+        context.set_pruning(0.0);
+        context.figure_iterations(300);
+        figurer::SearchStats before = context.stats();
+        EXPECT_GT(before.pruned_branches, 0);
+        // Pruned branches are kept on the cold list, so compaction keeps their nodes.
+        context.compact();
+        EXPECT_EQ(before.state_nodes, context.stats().state_nodes);
+        figurer::Plan plan = context.sample_plan();
+        ASSERT_FALSE(plan.actuations.empty());
+        EXPECT_GT(plan.actuations[0][0], 0.0);
+    }
+
+    TEST(FigurerContextTest, FreePrunedBranches) {
+        figurer::Context context = line_context(2, [](std::vector<double> state) { return 100 * state[0]; });
+        context.set_pruning(0.0, true);
+        context.figure_iterations(300);
+        figurer::SearchStats before = context.stats();
+        EXPECT_GT(before.pruned_branches, 0);
+        context.compact();
+        EXPECT_LT(context.stats().distribution_nodes, before.distribution_nodes);
+    }
+
+    TEST(FigurerContextTest, FreeingPrunedBranchesCompacts) {
+        // Periodic compaction reclaims freed branches without explicit calls.
+        std::vector<figurer::SearchStats> stats;
+        for(bool free_pruned : {false, true}) {
+            figurer::Context context = line_context(2, [](std::vector<double> state) { return 100 * state[0]; });
+            context.set_compaction_interval(100);
+            context.set_pruning(0.0, free_pruned);
+            context.figure_iterations(300);
+            stats.push_back(context.stats());
+        }
+        EXPECT_GT(stats[1].pruned_branches, 0);
+        EXPECT_LT(stats[1].distribution_nodes, stats[0].distribution_nodes);
+    }
+
+    TEST(FigurerContextTest, FreeingPrunedBranchesKeepsSearch) {
+        // Freed branches still count as samples, so until the next compaction the search
+        // makes the same choices as one that keeps them.
+        std::vector<figurer::SearchStats> stats;
+        for(bool free_pruned : {false, true}) {
+            figurer::Context context = line_context(2, [](std::vector<double> state) { return 100 * state[0]; });
+            context.set_pruning(0.0, free_pruned);
+            context.figure_iterations(300);
+            stats.push_back(context.stats());
+        }
+        EXPECT_GT(stats[0].pruned_branches, 0);
+        EXPECT_EQ(stats[0].pruned_branches, stats[1].pruned_branches);
+        EXPECT_EQ(stats[0].state_nodes, stats[1].state_nodes);
+        EXPECT_EQ(stats[0].distribution_nodes, stats[1].distribution_nodes);
+    }
+
+    TEST(FigurerContextTest, ExpansionRemembersTriedActions) {
+        figurer::StateNodeExpansion expansion(figurer::categorical_distribution({1.0, 2.0}), figurer::halton_sequence());
+        EXPECT_EQ(1, expansion.untried_action());
+        expansion.add_actuation(0, {1.0});
+        EXPECT_EQ(0, expansion.untried_action());
+        // Compaction clears the index and re-adds surviving children, so a freed
+        // child's action must not become untried again.
+        expansion.clear_actuations();
+        EXPECT_EQ(0, expansion.untried_action());
+        expansion.add_actuation(1, {0.0});
+        EXPECT_EQ(-1, expansion.untried_action());
+    }
+
+    TEST(FigurerContextTest, DiscreteActions) {
+        figurer::Context context;
+        context.set_depth(3);
+        context.set_initial_state({0.0});
+        context.set_value_fn([](std::vector<double> state) { return 100 * state[0]; });
+        context.set_policy_fn([](std::vector<double> state) {
+            return figurer::categorical_distribution({1.0, 1.0, 1.0});
+        });
+        // Action ids 0, 1 and 2 move left, stay and move right.
+        context.set_predict_fn([](std::vector<double> state, std::vector<double> actuation) {
+            double next = state[0] + actuation[0] - 1;
+            return figurer::uniform_distribution({next - 0.001, next + 0.001});
+        });
+        context.figure_iterations(300);
+        // Each action is tried exactly once at the root.
+        std::vector<figurer::RootAction> actions = context.root_actions();
+        ASSERT_EQ(3, actions.size());
+        std::vector<double> ids;
+        for(auto& action : actions) {
+            ASSERT_EQ(1, action.actuation.size());
+            ids.push_back(action.actuation[0]);
+        }
+        std::sort(ids.begin(), ids.end());
+        EXPECT_EQ(std::vector<double>({0.0, 1.0, 2.0}), ids);
+        figurer::Plan plan = context.principal_variation();
+        ASSERT_FALSE(plan.actuations.empty());
+        EXPECT_EQ(2.0, plan.actuations[0][0]);
+    }
+
+    TEST(FigurerContextTest, HybridActions) {
+        figurer::Context context;
+        context.set_depth(2);
+        context.set_initial_state({0.0});
+        context.set_value_fn([](std::vector<double> state) { return 100 * state[0]; });
+        context.set_policy_fn([](std::vector<double> state) {
+            return figurer::hybrid_distribution({1.0, 1.0}, {figurer::uniform_distribution({0.0, 1.0}),
+                                                             figurer::uniform_distribution({0.0, 1.0})});
+        });
+        // Action 0 moves left and action 1 moves right, by the continuous amount.
+        context.set_predict_fn([](std::vector<double> state, std::vector<double> actuation) {
+            double next = state[0] + (actuation[0] == 1 ? actuation[1] : -actuation[1]);
+            return figurer::uniform_distribution({next - 0.001, next + 0.001});
+        });
+        context.figure_iterations(300);
+        figurer::Plan plan = context.principal_variation();
+        ASSERT_FALSE(plan.actuations.empty());
+        ASSERT_EQ(2, plan.actuations[0].size());
+        EXPECT_EQ(1.0, plan.actuations[0][0]);
+        EXPECT_GT(plan.actuations[0][1], 0.5);
+    }
+
+    TEST(FigurerContextTest, BestActionCallback) {
+        figurer::Context context = line_context(2, [](std::vector<double> state) { return 100 * state[0]; });
+        std::vector<std::vector<double>> best_actions;
+        context.set_best_action_fn([&best_actions](const std::vector<double>& actuation) {
+            best_actions.push_back(actuation);
+        });
+        context.figure_iterations(300);
+        ASSERT_FALSE(best_actions.empty());
+        for(size_t i = 1; i < best_actions.size(); i++) {
+            EXPECT_NE(best_actions[i - 1], best_actions[i]);
+        }
+        // The plan follows the same best child that was last reported.
+        figurer::Plan plan = context.sample_plan();
+        ASSERT_FALSE(plan.actuations.empty());
+        EXPECT_EQ(best_actions.back(), plan.actuations[0]);
+    }
+
+    TEST(FigurerContextTest, BestActionCallbackAfterNewRoot) {
+        figurer::Context context;
+        context.set_depth(2);
+        context.set_initial_state({0.0});
+        context.set_value_fn([](std::vector<double> state) { return 100 * state[0]; });
+        // Moving right is tried first, so it is the best action from the first iteration.
+        context.set_policy_fn([](std::vector<double> state) {
+            return figurer::categorical_distribution({1.0, 1.0, 2.0});
+        });
+        context.set_predict_fn([](std::vector<double> state, std::vector<double> actuation) {
+            double next = state[0] + actuation[0] - 1;
+            return figurer::uniform_distribution({next - 0.001, next + 0.001});
+        });
+        std::vector<std::vector<double>> best_actions;
+        context.set_best_action_fn([&best_actions](const std::vector<double>& actuation) {
+            best_actions.push_back(actuation);
+        });
+        context.figure_iterations(50);
+        ASSERT_FALSE(best_actions.empty());
+        EXPECT_EQ(std::vector<double>({2.0}), best_actions.back());
+        // Every new root reports its best action, even when it is the same action as before.
+        int reported = best_actions.size();
+        context.reset({0.0});
+        context.figure_iterations(50);
+        ASSERT_GT(best_actions.size(), reported);
+        EXPECT_EQ(std::vector<double>({2.0}), best_actions.back());
+        reported = best_actions.size();
+        context.set_initial_state({1.0});
+        context.figure_iterations(50);
+        ASSERT_GT(best_actions.size(), reported);
+        EXPECT_EQ(std::vector<double>({2.0}), best_actions.back());
+    }
+}
@@ -37,4 +37,49 @@ namespace {
         EXPECT_TRUE(found_low_y) << "didn't find low y";
         EXPECT_TRUE(found_high_y) << "didn't find high y";
     }
+
+    TEST(FigurerDistributionTest, Mixture) {
+        figurer::Distribution mixture = figurer::mixture_distribution(
+                {figurer::uniform_distribution({0.0, 1.0}), figurer::uniform_distribution({10.0, 11.0})},
+                {3.0, 1.0});
+        EXPECT_EQ(2, mixture.seed_dimension());
+        EXPECT_DOUBLE_EQ(0.75, mixture.density({0.5}));
+        EXPECT_DOUBLE_EQ(0.25, mixture.density({10.5}));
+        EXPECT_DOUBLE_EQ(0.0, mixture.density({5.0}));
+        // First seed value picks the component and the second seeds it.
+        EXPECT_DOUBLE_EQ(0.5, mixture.sample({0.1, 0.5})[0]);
+        EXPECT_DOUBLE_EQ(10.5, mixture.sample({0.9, 0.5})[0]);
+        EXPECT_THROW(figurer::mixture_distribution({figurer::uniform_distribution({0.0, 1.0})}, {0.0}),
+                     std::invalid_argument);
+    }
+
+    TEST(FigurerDistributionTest, Categorical) {
+        figurer::Distribution categorical = figurer::categorical_distribution({1.0, 0.0, 3.0});
+        EXPECT_EQ(3, categorical.action_count());
+        EXPECT_FALSE(categorical.hybrid());
+        EXPECT_DOUBLE_EQ(0.25, categorical.action_probability(0));
+        EXPECT_DOUBLE_EQ(0.75, categorical.density({2.0}));
+        EXPECT_DOUBLE_EQ(0.0, categorical.density({1.0}));
+        EXPECT_DOUBLE_EQ(0.0, categorical.density({0.5}));
+        EXPECT_DOUBLE_EQ(0.0, categorical.density({3.0}));
+        EXPECT_DOUBLE_EQ(0.0, categorical.sample({0.1})[0]);
+        EXPECT_DOUBLE_EQ(2.0, categorical.sample({0.9})[0]);
+        EXPECT_THROW(figurer::categorical_distribution({}), std::invalid_argument);
+        EXPECT_THROW(figurer::categorical_distribution({-1.0, 2.0}), std::invalid_argument);
+    }
+
+    TEST(FigurerDistributionTest, Hybrid) {
+        figurer::Distribution hybrid = figurer::hybrid_distribution(
+                {1.0, 1.0}, {figurer::uniform_distribution({0.0, 1.0}), figurer::uniform_distribution({10.0, 12.0})});
+        EXPECT_EQ(2, hybrid.action_count());
+        EXPECT_TRUE(hybrid.hybrid());
+        EXPECT_EQ(2, hybrid.seed_dimension());
+        std::vector<double> sample = hybrid.sample({0.9, 0.5});
+        ASSERT_EQ(2, sample.size());
+        EXPECT_DOUBLE_EQ(1.0, sample[0]);
+        EXPECT_DOUBLE_EQ(11.0, sample[1]);
+        EXPECT_DOUBLE_EQ(0.5, hybrid.density({1.0, 11.0}));
+        EXPECT_DOUBLE_EQ(0.0, hybrid.density({0.0, 11.0}));
+        EXPECT_THROW(figurer::hybrid_distribution({1.0}, {}), std::invalid_argument);
+    }
 }
@@ -0,0 +1,43 @@
+#include "figurer_quasi_random.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+    TEST(FigurerQuasiRandomTest, RadicalInverse) {
+        EXPECT_DOUBLE_EQ(0.0, figurer::radical_inverse(0, 2));
+        EXPECT_DOUBLE_EQ(0.5, figurer::radical_inverse(1, 2));
+        EXPECT_DOUBLE_EQ(0.25, figurer::radical_inverse(2, 2));
+        EXPECT_DOUBLE_EQ(0.75, figurer::radical_inverse(3, 2));
+        EXPECT_DOUBLE_EQ(1.0 / 9.0, figurer::radical_inverse(3, 3));
+    }
+
+    TEST(FigurerQuasiRandomTest, Stratified) {
+        figurer::halton_sequence sequence(12345);
+        // First coordinate uses base 2, so 16 points land one per sixteenth.
+        // Second coordinate uses base 3, so 9 points land one per ninth.
+        std::vector<int> sixteenths(16, 0);
+        std::vector<int> ninths(9, 0);
+        for(int i = 0; i < 144; i++) {
+            std::vector<double> point = sequence.next(2);
+            ASSERT_EQ(2, point.size());
+            ASSERT_GE(point[0], 0.0);
+            ASSERT_LT(point[0], 1.0);
+            ASSERT_GE(point[1], 0.0);
+            ASSERT_LT(point[1], 1.0);
+            sixteenths[(int) (point[0] * 16)]++;
+            ninths[(int) (point[1] * 9)]++;
+        }
+        for(int count : sixteenths) {
+            EXPECT_EQ(9, count);
+        }
+        for(int count : ninths) {
+            EXPECT_EQ(16, count);
+        }
+        EXPECT_EQ(144, sequence.count());
+    }
+
+    TEST(FigurerQuasiRandomTest, ScrambleShiftsSequence) {
+        figurer::halton_sequence a(1);
+        figurer::halton_sequence b(2);
+        EXPECT_NE(a.next(3), b.next(3));
+    }
+}
@@ -0,0 +1,139 @@
+#include "figurer_root_parallel.hpp"
+#include "figurer_robot2d_example.hpp"
+#include "gtest/gtest.h"
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    std::string segment_name(const char* test) {
+        return std::string("/figurer_") + test + "_" + std::to_string(getpid());
+    }
+
+    TEST(FigurerRootParallelTest, UnpublishedWorkerHasNoSnapshot) {
+        figurer::RootParallelCoordinator coordinator(segment_name("unpublished"), 2, 2, 2);
+        figurer::WorkerSnapshot snapshot;
+        EXPECT_FALSE(coordinator.snapshot(0, snapshot));
+        EXPECT_TRUE(coordinator.merged_root_actions().empty());
+        EXPECT_TRUE(coordinator.merged_plan().actuations.empty());
+        EXPECT_THROW(coordinator.snapshot(2, snapshot), std::invalid_argument);
+    }
+
+    TEST(FigurerRootParallelTest, SegmentNameInUse) {
+        std::string name = segment_name("in_use");
+        figurer::RootParallelCoordinator coordinator(name, 1, 2, 2);
+        EXPECT_THROW(figurer::RootParallelCoordinator(name, 1, 2, 2), std::invalid_argument);
+        // The first coordinator's segment is still there for workers to open.
+        figurer::RootParallelWorker worker(name, 0);
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.figure_iterations(20);
+        worker.publish(context);
+        figurer::WorkerSnapshot snapshot;
+        EXPECT_TRUE(coordinator.snapshot(0, snapshot));
+    }
+
+    TEST(FigurerRootParallelTest, PublishAndMergeInProcess) {
+        std::string name = segment_name("in_process");
+        figurer::RootParallelCoordinator coordinator(name, 2, 2, 2, 4, 8);
+        figurer::RootParallelWorker worker0(name, 0);
+        figurer::RootParallelWorker worker1(name, 1);
+        figurer::Context context0 = figurer_robot2d_example::robot2d_context();
+        figurer::Context context1 = figurer_robot2d_example::robot2d_context();
+        context0.figure_iterations(200);
+        context1.figure_iterations(200);
+        worker0.publish(context0);
+        worker0.publish(context0);
+        worker1.publish(context1);
+        figurer::WorkerSnapshot snapshot;
+        ASSERT_TRUE(coordinator.snapshot(0, snapshot));
+        EXPECT_EQ(2, snapshot.publications);
+        EXPECT_FALSE(snapshot.root_actions.empty());
+        EXPECT_LE(snapshot.root_actions.size(), 4);
+        EXPECT_LE(snapshot.plan.actuations.size(), 8);
+        EXPECT_EQ(snapshot.plan.states.size(), snapshot.plan.actuations.size() + 1);
+        // Without merging, every action from both workers is kept.
+        ASSERT_TRUE(coordinator.snapshot(1, snapshot));
+        int separate = coordinator.merged_root_actions().size();
+        EXPECT_GE(separate, snapshot.root_actions.size());
+        // With a radius covering the whole actuation box, everything merges into one action.
+        std::vector<figurer::RootAction> merged = coordinator.merged_root_actions(10);
+        ASSERT_EQ(1, merged.size());
+        EXPECT_GT(merged[0].visits, 0);
+        figurer::Plan plan = coordinator.merged_plan();
+        EXPECT_FALSE(plan.actuations.empty());
+        EXPECT_THROW(figurer::RootParallelWorker(name + "_missing", 0), std::invalid_argument);
+    }
+
+    figurer::Context line_context(double low, double high) {
+        figurer::Context context;
+        context.set_depth(1);
+        context.set_initial_state({0.0});
+        context.set_value_fn([](std::vector<double> state) { return state[0] < 0 ? 1.0 : 0.0; });
+        context.set_policy_fn([low, high](std::vector<double> state) {
+            return figurer::uniform_distribution({low, high});
+        });
+        context.set_predict_fn([](std::vector<double> state, std::vector<double> actuation) {
+            return figurer::uniform_distribution({state[0] + actuation[0] - 0.001, state[0] + actuation[0] + 0.001});
+        });
+        return context;
+    }
+
+    TEST(FigurerRootParallelTest, MergedPlanPrefersVisits) {
+        std::string name = segment_name("visits");
+        figurer::RootParallelCoordinator coordinator(name, 2, 1, 1);
+        figurer::RootParallelWorker worker0(name, 0);
+        figurer::RootParallelWorker worker1(name, 1);
+        // Worker 0 keeps returning to actuations near 1. Worker 1 saw one better
+        // actuation near -1 before publishing.
+        figurer::Context context0 = line_context(0.9, 1.1);
+        figurer::Context context1 = line_context(-1.1, -0.9);
+        context0.figure_iterations(100);
+        context1.figure_iterations(1);
+        worker0.publish(context0);
+        worker1.publish(context1);
+        std::vector<figurer::RootAction> merged = coordinator.merged_root_actions(0.5);
+        ASSERT_EQ(2, merged.size());
+        figurer::Plan plan = coordinator.merged_plan(0.5);
+        ASSERT_FALSE(plan.actuations.empty());
+        EXPECT_NEAR(1.0, plan.actuations[0][0], 0.11);
+    }
+
+    TEST(FigurerRootParallelTest, WorkerProcesses) {
+        std::string name = segment_name("processes");
+        const int workers = 2;
+        figurer::RootParallelCoordinator coordinator(name, workers, 2, 2);
+        std::vector<pid_t> children;
+        for(int w = 0; w < workers; w++) {
+            pid_t pid = fork();
+            ASSERT_GE(pid, 0);
+            if(pid == 0) {
+                int status = 0;
+                try {
+                    figurer::RootParallelWorker worker(name, w);
+                    figurer::Context context = figurer_robot2d_example::robot2d_context();
+                    context.set_seed(w + 1);
+                    worker.figure_seconds(context, 0.1, 0.02);
+                } catch(...) {
+                    status = 1;
+                }
+                // Skip test framework teardown in the child.
+                _exit(status);
+            }
+            children.push_back(pid);
+        }
+        for(pid_t child : children) {
+            int status = 0;
+            waitpid(child, &status, 0);
+            EXPECT_TRUE(WIFEXITED(status));
+            EXPECT_EQ(0, WEXITSTATUS(status));
+        }
+        figurer::WorkerSnapshot snapshot;
+        for(int w = 0; w < workers; w++) {
+            ASSERT_TRUE(coordinator.snapshot(w, snapshot));
+            EXPECT_GT(snapshot.publications, 0);
+        }
+        figurer::Plan plan = coordinator.merged_plan(0.1);
+        ASSERT_FALSE(plan.actuations.empty());
+        EXPECT_EQ(2, plan.actuations[0].size());
+    }
+}
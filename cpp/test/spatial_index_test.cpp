@@ -1,5 +1,7 @@
 #include "figurer_spatial_index.hpp"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <random>
 
 namespace {
     TEST(FigurerSpatialIndexTest, SpatialIndex) {
@@ -12,4 +14,117 @@ namespace {
         auto found = index.closest(std::vector<double>{41,19,29});
         EXPECT_EQ(104, found.first);
     }
-}
\ No newline at end of file
+
+    TEST(FigurerSpatialIndexTest, ClosestK) {
+        auto index = figurer::spatial_index(3);
+        index.add(101, std::vector<double>{10,20,30});
+        index.add(102, std::vector<double>{20,30,40});
+        index.add(103, std::vector<double>{30,40,50});
+        index.add(104, std::vector<double>{40,20,30});
+        index.add(105, std::vector<double>{20,40,30});
+        auto found = index.closest_k(std::vector<double>{41,19,29}, 3);
+        ASSERT_EQ(3, found.size());
+        EXPECT_EQ(104, found[0].first);
+        EXPECT_EQ(102, found[1].first);
+        EXPECT_EQ(105, found[2].first);
+        EXPECT_EQ(5, index.closest_k(std::vector<double>{0,0,0}, 10).size());
+    }
+
+    // Points near a random 3 dimensional subspace of a 30 dimensional space, like
+    // states that vary in only a few independent ways.
+    class subspace_points {
+        static const int intrinsic_dimension = 3;
+        std::mt19937 generator_;
+        std::vector<double> basis_;
+    public:
+        static const int dimension = 30;
+        subspace_points() : generator_(1) {
+            std::normal_distribution<double> normal(0.0, 1.0);
+            for(int i = 0; i < intrinsic_dimension * dimension; i++) {
+                basis_.push_back(normal(generator_));
+            }
+        }
+        std::vector<double> next() {
+            std::uniform_real_distribution<double> latent(-10.0, 10.0);
+            std::normal_distribution<double> noise(0.0, 0.1);
+            std::vector<double> point(dimension, 0.0);
+            for(int k = 0; k < intrinsic_dimension; k++) {
+                double weight = latent(generator_);
+                for(int j = 0; j < dimension; j++) {
+                    point[j] += weight * basis_[k * dimension + j];
+                }
+            }
+            for(double& x : point) {
+                x += noise(generator_);
+            }
+            return point;
+        }
+    };
+
+    TEST(FigurerSpatialIndexTest, ApproximateRecall) {
+        // Queries are drawn independently of the stored points, so the closest point
+        // isn't simply a perturbed copy of the query.
+        std::vector<int> hits;
+        for(int candidates : {5, 50}) {
+            subspace_points points;
+            figurer::spatial_index index(subspace_points::dimension);
+            figurer::spatial_index exact(subspace_points::dimension);
+            index.set_approximate(8, candidates, 1);
+            for(int i = 0; i < 1000; i++) {
+                std::vector<double> point = points.next();
+                index.add(i, point);
+                exact.add(i, point);
+            }
+            int found_count = 0;
+            for(int i = 0; i < 200; i++) {
+                std::vector<double> query = points.next();
+                if(index.closest(query).first == exact.closest(query).first) {
+                    found_count++;
+                }
+            }
+            EXPECT_EQ(200, index.recall_samples());
+            EXPECT_EQ(found_count, index.recall_hits());
+            hits.push_back(found_count);
+        }
+        // More candidates trades speed for recall.
+        EXPECT_LT(hits[0], 150);
+        EXPECT_GT(hits[1], 185);
+    }
+
+    TEST(FigurerSpatialIndexTest, ApproximateClosestK) {
+        subspace_points points;
+        figurer::spatial_index index(subspace_points::dimension);
+        figurer::spatial_index exact(subspace_points::dimension);
+        index.set_approximate(8, 50);
+        for(int i = 0; i < 1000; i++) {
+            std::vector<double> point = points.next();
+            index.add(i, point);
+            exact.add(i, point);
+        }
+        int found_count = 0;
+        for(int i = 0; i < 100; i++) {
+            std::vector<double> query = points.next();
+            auto found = index.closest_k(query, 5);
+            auto expected = exact.closest_k(query, 5);
+            ASSERT_EQ(5, found.size());
+            for(size_t a = 1; a < found.size(); a++) {
+                EXPECT_LE(figurer::distance2(query, found[a - 1].second), figurer::distance2(query, found[a].second));
+            }
+            for(auto& neighbor : expected) {
+                found_count += std::any_of(found.begin(), found.end(),
+                        [&neighbor](const std::pair<int,std::vector<double>>& f) { return f.first == neighbor.first; });
+            }
+        }
+        EXPECT_GT(found_count, 450);
+    }
+
+    TEST(FigurerSpatialIndexTest, ApproximateWithFewPointsIsExact) {
+        figurer::spatial_index index;
+        index.set_approximate(1, 10);
+        index.add(101, std::vector<double>{10,20,30});
+        index.add(102, std::vector<double>{20,30,40});
+        index.add(104, std::vector<double>{40,20,30});
+        EXPECT_EQ(104, index.closest(std::vector<double>{41,19,29}).first);
+        EXPECT_EQ(0, index.recall_samples());
+    }
+}
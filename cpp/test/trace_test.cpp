@@ -0,0 +1,86 @@
+#include "figurer_trace.hpp"
+#include "figurer_robot2d_example.hpp"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifndef FIGURER_DISABLE_TRACING
+namespace {
+    int count_occurrences(const std::string& text, const std::string& pattern) {
+        int count = 0;
+        for(size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) {
+            count++;
+        }
+        return count;
+    }
+
+    TEST(FigurerTraceTest, ChromeTraceIncludesPhasesAndCallbacks) {
+        figurer::enable_tracing();
+        figurer::clear_trace();
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.figure_iterations(10);
+        figurer::disable_tracing();
+        std::ostringstream trace;
+        figurer::write_chrome_trace(trace);
+        std::string json = trace.str();
+        EXPECT_EQ(0, json.find("{\"traceEvents\":["));
+        EXPECT_EQ(10, count_occurrences(json, "\"figure_once\""));
+        EXPECT_GT(count_occurrences(json, "\"create_from_state_node\""), 0);
+        EXPECT_GT(count_occurrences(json, "\"refresh_state_node\""), 0);
+        EXPECT_GT(count_occurrences(json, "\"spatial_index::closest\""), 0);
+        EXPECT_GT(count_occurrences(json, "\"value_fn\""), 0);
+        EXPECT_GT(count_occurrences(json, "\"predict_fn\""), 0);
+    }
+
+    TEST(FigurerTraceTest, RingBufferKeepsMostRecentEvents) {
+        figurer::enable_tracing(16);
+        figurer::Context context = figurer_robot2d_example::robot2d_context();
+        context.figure_iterations(10);
+        figurer::disable_tracing();
+        std::ostringstream trace;
+        figurer::write_chrome_trace(trace);
+        EXPECT_EQ(16, count_occurrences(trace.str(), "\"ph\":\"X\""));
+        figurer::enable_tracing();
+        figurer::disable_tracing();
+        figurer::clear_trace();
+    }
+
+    TEST(FigurerTraceTest, DumpWhileRecordingHasNoTornEvents) {
+        figurer::enable_tracing(16);
+        figurer::clear_trace();
+        std::atomic<bool> done{false};
+        // Every field of event i encodes i, so a torn event has mismatched fields.
+        std::thread writer([&done]() {
+            for(int64_t i = 0; i < 200000; i++) {
+                figurer::trace_internal::record(i % 2 == 0 ? "even" : "odd", i * 1000, i * 2000);
+            }
+            done = true;
+        });
+        int checked = 0;
+        while(!done || checked == 0) {
+            std::ostringstream trace;
+            figurer::write_chrome_trace(trace);
+            std::istringstream lines(trace.str());
+            std::string line;
+            while(std::getline(lines, line)) {
+                char name[8];
+                double ts, dur;
+                if(sscanf(line.c_str(), "{\"name\":\"%7[a-z]\",\"ph\":\"X\",\"pid\":1,\"tid\":%*d,\"ts\":%lf,\"dur\":%lf",
+                          name, &ts, &dur) != 3) {
+                    continue;
+                }
+                EXPECT_EQ(ts, dur);
+                EXPECT_EQ(((long) ts) % 2 == 0 ? "even" : "odd", std::string(name));
+                checked++;
+            }
+        }
+        writer.join();
+        EXPECT_GT(checked, 0);
+        figurer::disable_tracing();
+        figurer::clear_trace();
+    }
+}
+#endif